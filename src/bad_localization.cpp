@@ -3,6 +3,7 @@
 #include "image_writer.h"
 #include "world_model.h"
 #include "lrf.h"
+#include "scan_matcher.h"
 
 // ----------------------------------------------------------------------------------------------------
 
@@ -57,5 +58,19 @@ void badLocalization(ImageWriter& iw)
         drawRanges(canvas, lrf, offset * lrf_pose, ranges_virtual, Color(255, 0, 0, 3));
         drawRanges(canvas, lrf, offset * lrf_pose, ranges_real, Color(0, 150, 0, 3), Color(200, 200, 200));
         iw.process(canvas);
+
+        // Correct the pose by matching the real scan against the world model
+        SegmentGrid grid;
+        grid.addWorldModel(wm_t);
+        grid.build();
+
+        geo::Transform2 lrf_pose_corrected = offset * lrf_pose;
+        matchScan(lrf, ranges_real, grid, lrf_pose_corrected);
+
+        canvas = iw.nextCanvas();
+        drawWorld(canvas, wm_t);
+        drawRanges(canvas, lrf, lrf_pose_corrected, ranges_real, Color(0, 150, 0, 3), Color(200, 200, 200));
+        drawLRFPose(canvas, lrf_pose_corrected, Color(0, 150, 0, 2));
+        iw.process(canvas);
     }
 }
@@ -0,0 +1,166 @@
+#include "beam_clustering.h"
+
+#include <algorithm>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+bool lessXY(const geo::Vec2& p1, const geo::Vec2& p2)
+{
+    return p1.x < p2.x || (p1.x == p2.x && p1.y < p2.y);
+}
+
+double cross(const geo::Vec2& o, const geo::Vec2& a, const geo::Vec2& b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void clusterBeams(const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
+                  const std::vector<unsigned char>& mask, const BeamClusteringParameters& params,
+                  std::vector<BeamCluster>& clusters)
+{
+    clusters.clear();
+
+    double max_gap2 = params.max_gap * params.max_gap;
+    int num_beams = std::min(ranges.size(), mask.size());
+
+    BeamCluster* current = 0;
+    geo::Vec2 p_last;
+
+    for(int i = 0; i < num_beams; ++i)
+    {
+        double r = ranges[i];
+        if (!mask[i] || r <= 0)
+            continue;
+
+        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+        geo::Vec2 p = lrf_pose * geo::Vec2(r * ray_dir.x, r * ray_dir.y);
+
+        if (current)
+        {
+            geo::Vec2 diff = p - p_last;
+            if (i - current->i_last - 1 > params.max_skipped_beams || diff.x * diff.x + diff.y * diff.y > max_gap2)
+            {
+                if ((int)current->points.size() < params.min_beams)
+                    clusters.pop_back();
+                current = 0;
+            }
+        }
+
+        if (!current)
+        {
+            clusters.push_back(BeamCluster());
+            current = &clusters.back();
+            current->i_first = i;
+        }
+
+        current->i_last = i;
+        current->points.push_back(p);
+        p_last = p;
+    }
+
+    if (current && (int)current->points.size() < params.min_beams)
+        clusters.pop_back();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void createConvexHullContour(const std::vector<geo::Vec2>& points, Contour2D& c)
+{
+    // Andrew's monotone chain
+    std::vector<geo::Vec2> sorted = points;
+    std::sort(sorted.begin(), sorted.end(), lessXY);
+
+    int n = sorted.size();
+    if (n < 3)
+    {
+        c.points.insert(c.points.end(), sorted.begin(), sorted.end());
+        return;
+    }
+
+    std::vector<geo::Vec2> hull(2 * n);
+    int k = 0;
+
+    for(int i = 0; i < n; ++i)
+    {
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], sorted[i]) <= 0)
+            --k;
+        hull[k++] = sorted[i];
+    }
+
+    for(int i = n - 2, t = k + 1; i >= 0; --i)
+    {
+        while (k >= t && cross(hull[k - 2], hull[k - 1], sorted[i]) <= 0)
+            --k;
+        hull[k++] = sorted[i];
+    }
+
+    // The chain is counter-clockwise and ends with the first point again: reverse it to clockwise
+    for(int i = k - 2; i >= 0; --i)
+        c.points.push_back(hull[i]);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+Entity2D createClusterEntity(const BeamCluster& cluster, ClusterShape shape, const Color& color)
+{
+    const std::vector<geo::Vec2>& points = cluster.points;
+
+    geo::Vec2 center(0, 0);
+    for(unsigned int i = 0; i < points.size(); ++i)
+        center += points[i];
+    if (!points.empty())
+        center = center * (1.0 / points.size());
+
+    if (shape == CLUSTER_ORIENTED_BOX)
+    {
+        double sxx = 0, sxy = 0, syy = 0;
+        for(unsigned int i = 0; i < points.size(); ++i)
+        {
+            geo::Vec2 d = points[i] - center;
+            sxx += d.x * d.x;
+            sxy += d.x * d.y;
+            syy += d.y * d.y;
+        }
+
+        double a = 0.5 * atan2(2 * sxy, sxx - syy);
+        geo::Transform2 pose = fromXYA(center.x, center.y, a);
+        geo::Transform2 pose_inv = pose.inverse();
+
+        geo::Vec2 p_min(1e9, 1e9);
+        geo::Vec2 p_max(-1e9, -1e9);
+        for(unsigned int i = 0; i < points.size(); ++i)
+        {
+            geo::Vec2 p = pose_inv * points[i];
+            p_min.x = std::min(p_min.x, p.x);
+            p_min.y = std::min(p_min.y, p.y);
+            p_max.x = std::max(p_max.x, p.x);
+            p_max.y = std::max(p_max.y, p.y);
+        }
+
+        return Entity2D(createBox(p_min, p_max), pose, color);
+    }
+
+    std::vector<geo::Vec2> points_local(points.size());
+    for(unsigned int i = 0; i < points.size(); ++i)
+        points_local[i] = points[i] - center;
+
+    Model2D model;
+    createConvexHullContour(points_local, model.addContour());
+
+    return Entity2D(model, fromXYA(center.x, center.y, 0), color);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void addClusterEntities(const std::vector<BeamCluster>& clusters, WorldModel2D& wm, ClusterShape shape, const Color& color)
+{
+    for(unsigned int i = 0; i < clusters.size(); ++i)
+        wm.addEntity(createClusterEntity(clusters[i], shape, color));
+}
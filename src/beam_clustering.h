@@ -0,0 +1,63 @@
+#ifndef _BEAM_CLUSTERING_H_
+#define _BEAM_CLUSTERING_H_
+
+#include "world_model.h"
+
+#include <geolib/sensors/LaserRangeFinder.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+struct BeamCluster
+{
+    // Beams i_first ... i_last (inclusive); beams in between that were not in the mask are skipped
+    int i_first;
+    int i_last;
+
+    // End points in world coordinates
+    std::vector<geo::Vec2> points;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+struct BeamClusteringParameters
+{
+    BeamClusteringParameters() : max_gap(0.2), max_skipped_beams(1), min_beams(2) {}
+
+    // Maximum distance (m) between the end points of consecutive beams in a cluster
+    double max_gap;
+
+    // Maximum number of beams not in the mask between consecutive beams in a cluster
+    int max_skipped_beams;
+
+    // Smaller clusters are dropped
+    int min_beams;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Groups the beams in 'mask' (e.g. ScanAssociation::unassociated) by adjacency along the beam index.
+// Runs in a single pass over the beams.
+void clusterBeams(const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
+                  const std::vector<unsigned char>& mask, const BeamClusteringParameters& params,
+                  std::vector<BeamCluster>& clusters);
+
+// ----------------------------------------------------------------------------------------------------
+
+enum ClusterShape
+{
+    CLUSTER_CONVEX_HULL,
+    CLUSTER_ORIENTED_BOX
+};
+
+// Creates an entity that covers the cluster points. The entity pose is at the cluster centroid (and
+// aligned with the principal axis for an oriented box).
+Entity2D createClusterEntity(const BeamCluster& cluster, ClusterShape shape = CLUSTER_CONVEX_HULL,
+                             const Color& color = Color(0, 0, 0, 2));
+
+void addClusterEntities(const std::vector<BeamCluster>& clusters, WorldModel2D& wm, ClusterShape shape = CLUSTER_CONVEX_HULL,
+                        const Color& color = Color(0, 0, 0, 2));
+
+// Convex hull of the points, clockwise like the contours created by createBox()
+void createConvexHullContour(const std::vector<geo::Vec2>& points, Contour2D& c);
+
+#endif
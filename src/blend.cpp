@@ -0,0 +1,229 @@
+#include "blend.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+// Exact round(x / 255) for x in [0, 255 * 255]
+inline int div255(int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Weights outside [0, 256] would overflow the fixed-point results
+inline double clampAlpha(double alpha)
+{
+    return std::min(1.0, std::max(0.0, alpha));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+class BlendConstant : public cv::ParallelLoopBody
+{
+
+public:
+
+    BlendConstant(const cv::Mat& src, const cv::Scalar& color, double alpha, cv::Mat& dst) : src_(src), dst_(dst)
+    {
+        a_ = cvRound(alpha * 256);
+
+        // Constant term for a whole row, so the inner loop does not need to know about channels
+        add_.resize(src.cols * 3);
+        for(int x = 0; x < src.cols; ++x)
+            for(int k = 0; k < 3; ++k)
+                add_[x * 3 + k] = cv::saturate_cast<unsigned char>(color[k]) * a_ + 128;
+    }
+
+    void operator()(const cv::Range& r) const
+    {
+        int n = src_.cols * 3;
+        int b = 256 - a_;
+        const int* add = &add_[0];
+
+        for(int y = r.start; y < r.end; ++y)
+        {
+            const unsigned char* s = src_.ptr<unsigned char>(y);
+            unsigned char* d = dst_.ptr<unsigned char>(y);
+
+            for(int i = 0; i < n; ++i)
+                d[i] = (unsigned char)((add[i] + s[i] * b) >> 8);
+        }
+    }
+
+private:
+
+    const cv::Mat& src_;
+    cv::Mat& dst_;
+    int a_;
+    std::vector<int> add_;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+class Fade : public cv::ParallelLoopBody
+{
+
+public:
+
+    Fade(const cv::Mat& src1, const cv::Mat& src2, double alpha, cv::Mat& dst)
+        : src1_(src1), src2_(src2), dst_(dst), a_(cvRound(alpha * 256)) {}
+
+    void operator()(const cv::Range& r) const
+    {
+        int n = src1_.cols * 3;
+        int b = 256 - a_;
+
+        for(int y = r.start; y < r.end; ++y)
+        {
+            const unsigned char* s1 = src1_.ptr<unsigned char>(y);
+            const unsigned char* s2 = src2_.ptr<unsigned char>(y);
+            unsigned char* d = dst_.ptr<unsigned char>(y);
+
+            for(int i = 0; i < n; ++i)
+                d[i] = (unsigned char)((s1[i] * a_ + s2[i] * b + 128) >> 8);
+        }
+    }
+
+private:
+
+    const cv::Mat& src1_;
+    const cv::Mat& src2_;
+    cv::Mat& dst_;
+    int a_;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+class CompositeAlpha : public cv::ParallelLoopBody
+{
+
+public:
+
+    CompositeAlpha(const cv::Mat& src, const cv::Mat& overlay, const cv::Mat& mask, cv::Mat& dst)
+        : src_(src), overlay_(overlay), mask_(mask), dst_(dst) {}
+
+    void operator()(const cv::Range& r) const
+    {
+        for(int y = r.start; y < r.end; ++y)
+        {
+            const unsigned char* s = src_.ptr<unsigned char>(y);
+            const unsigned char* o = overlay_.ptr<unsigned char>(y);
+            const unsigned char* m = mask_.ptr<unsigned char>(y);
+            unsigned char* d = dst_.ptr<unsigned char>(y);
+
+            for(int x = 0; x < src_.cols; ++x)
+            {
+                int a = m[x];
+                int b = 255 - a;
+                for(int k = 0; k < 3; ++k)
+                    d[3 * x + k] = div255(o[3 * x + k] * a + s[3 * x + k] * b);
+            }
+        }
+    }
+
+private:
+
+    const cv::Mat& src_;
+    const cv::Mat& overlay_;
+    const cv::Mat& mask_;
+    cv::Mat& dst_;
+};
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void blendConstant(const cv::Mat& src, const cv::Scalar& color, double alpha, cv::Mat& dst)
+{
+    CV_Assert(src.type() == CV_8UC3);
+
+    if (dst.data != src.data)
+        dst.create(src.rows, src.cols, CV_8UC3);
+
+    cv::parallel_for_(cv::Range(0, src.rows), BlendConstant(src, color, clampAlpha(alpha), dst));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void fade(const cv::Mat& src1, const cv::Mat& src2, double alpha, cv::Mat& dst)
+{
+    CV_Assert(src1.type() == CV_8UC3 && src2.type() == CV_8UC3 && src1.size() == src2.size());
+
+    if (dst.data != src1.data && dst.data != src2.data)
+        dst.create(src1.rows, src1.cols, CV_8UC3);
+
+    cv::parallel_for_(cv::Range(0, src1.rows), Fade(src1, src2, clampAlpha(alpha), dst));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void compositeAlpha(const cv::Mat& src, const cv::Mat& overlay, const cv::Mat& mask, cv::Mat& dst)
+{
+    CV_Assert(src.type() == CV_8UC3 && overlay.type() == CV_8UC3 && mask.type() == CV_8UC1);
+    CV_Assert(src.size() == overlay.size() && src.size() == mask.size());
+
+    if (dst.data != src.data && dst.data != overlay.data)
+        dst.create(src.rows, src.cols, CV_8UC3);
+
+    cv::parallel_for_(cv::Range(0, src.rows), CompositeAlpha(src, overlay, mask, dst));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void compositeColor(cv::Mat& image, const cv::Scalar& color, const cv::Mat& mask, const cv::Point& offset)
+{
+    CV_Assert(image.type() == CV_8UC3 && mask.type() == CV_8UC1);
+
+    // Masks are small (glyphs), so this one runs on the calling thread
+    int x_min = std::max(0, -offset.x);
+    int y_min = std::max(0, -offset.y);
+    int x_max = std::min(mask.cols, image.cols - offset.x);
+    int y_max = std::min(mask.rows, image.rows - offset.y);
+
+    int c0 = cv::saturate_cast<unsigned char>(color[0]);
+    int c1 = cv::saturate_cast<unsigned char>(color[1]);
+    int c2 = cv::saturate_cast<unsigned char>(color[2]);
+
+    for(int y = y_min; y < y_max; ++y)
+    {
+        const unsigned char* m = mask.ptr<unsigned char>(y);
+        unsigned char* d = image.ptr<unsigned char>(y + offset.y) + 3 * offset.x;
+
+        for(int x = x_min; x < x_max; ++x)
+        {
+            int a = m[x];
+            if (a == 0)
+                continue;
+
+            int b = 255 - a;
+            unsigned char* p = d + 3 * x;
+            p[0] = div255(c0 * a + p[0] * b);
+            p[1] = div255(c1 * a + p[1] * b);
+            p[2] = div255(c2 * a + p[2] * b);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void stampIndex(cv::Mat& image, unsigned char index, const cv::Mat& mask, const cv::Point& offset)
+{
+    int x_min = std::max(0, -offset.x);
+    int y_min = std::max(0, -offset.y);
+    int x_max = std::min(mask.cols, image.cols - offset.x);
+    int y_max = std::min(mask.rows, image.rows - offset.y);
+
+    for(int y = y_min; y < y_max; ++y)
+    {
+        const unsigned char* m = mask.ptr<unsigned char>(y);
+        unsigned char* d = image.ptr<unsigned char>(y + offset.y) + offset.x;
+
+        for(int x = x_min; x < x_max; ++x)
+        {
+            if (m[x] >= 128)
+                d[x] = index;
+        }
+    }
+}
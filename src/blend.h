@@ -0,0 +1,31 @@
+#ifndef _BLEND_H_
+#define _BLEND_H_
+
+#include <opencv2/core/core.hpp>
+
+// ----------------------------------------------------------------------------------------------------
+//
+// Blending kernels for CV_8UC3 images. All of them use 8-bit fixed-point arithmetic in straight loops
+// over the row bytes (so the compiler can vectorize them) and run over the rows in parallel. 'dst' may
+// be the same image as 'src'. Alpha values are clamped to [0, 1] and colors to [0, 255].
+//
+// ----------------------------------------------------------------------------------------------------
+
+// dst = alpha * color + (1 - alpha) * src
+void blendConstant(const cv::Mat& src, const cv::Scalar& color, double alpha, cv::Mat& dst);
+
+// dst = alpha * src1 + (1 - alpha) * src2
+void fade(const cv::Mat& src1, const cv::Mat& src2, double alpha, cv::Mat& dst);
+
+// dst = m * overlay + (1 - m) * src, with m = mask / 255 (mask is CV_8UC1)
+void compositeAlpha(const cv::Mat& src, const cv::Mat& overlay, const cv::Mat& mask, cv::Mat& dst);
+
+// Blends a constant color into 'image' through 'mask' (CV_8UC1), with the top-left corner of the mask at
+// 'offset' in the image. Parts of the mask that fall outside the image are skipped.
+void compositeColor(cv::Mat& image, const cv::Scalar& color, const cv::Mat& mask, const cv::Point& offset);
+
+// compositeColor for CV_8UC1 palette images, which can not be blended: sets 'index' where the mask is at
+// least half
+void stampIndex(cv::Mat& image, unsigned char index, const cv::Mat& mask, const cv::Point& offset);
+
+#endif
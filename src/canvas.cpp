@@ -0,0 +1,319 @@
+#include "canvas.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <climits>
+#include <iostream>
+#include <sstream>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+bool check_snapshots = false;
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int Palette::index(const cv::Scalar& color)
+{
+    cv::Vec3b c(cv::saturate_cast<unsigned char>(color[0]), cv::saturate_cast<unsigned char>(color[1]),
+                cv::saturate_cast<unsigned char>(color[2]));
+
+    for(unsigned int i = 0; i < colors_.size(); ++i)
+    {
+        if (colors_[i] == c)
+            return i;
+    }
+
+    if (colors_.size() < 256)
+    {
+        colors_.push_back(c);
+        return colors_.size() - 1;
+    }
+
+    if (!full_reported_)
+    {
+        std::cout << "Palette: more than 256 colors, drawing the others in the nearest color" << std::endl;
+        full_reported_ = true;
+    }
+
+    return nearest(c);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int Palette::blend(int i, const cv::Scalar& color, int alpha)
+{
+    cv::Vec3b c = colors_[i];
+
+    cv::Scalar blended;
+    for(int k = 0; k < 3; ++k)
+        blended[k] = (alpha * color[k] + (255 - alpha) * c[k]) / 255;
+
+    return index(blended);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int Palette::nearest(const cv::Vec3b& color) const
+{
+    int i_best = 0;
+    int d_best = INT_MAX;
+    for(unsigned int i = 0; i < colors_.size(); ++i)
+    {
+        int d = 0;
+        for(int k = 0; k < 3; ++k)
+        {
+            int diff = (int)colors_[i][k] - (int)color[k];
+            d += diff * diff;
+        }
+
+        if (d < d_best)
+        {
+            i_best = i;
+            d_best = d;
+        }
+    }
+
+    return i_best;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Palette::quantize(const cv::Mat& bgr, cv::Mat& indices) const
+{
+    CV_Assert(bgr.type() == CV_8UC3);
+    indices.create(bgr.rows, bgr.cols, CV_8UC1);
+
+    // Images are mostly areas of one color, so remember the previous pixel
+    cv::Vec3b c_prev(0, 0, 0);
+    int i_prev = nearest(c_prev);
+
+    for(int y = 0; y < bgr.rows; ++y)
+    {
+        const cv::Vec3b* s = bgr.ptr<cv::Vec3b>(y);
+        unsigned char* d = indices.ptr<unsigned char>(y);
+
+        for(int x = 0; x < bgr.cols; ++x)
+        {
+            if (s[x] != c_prev)
+            {
+                c_prev = s[x];
+                i_prev = nearest(c_prev);
+            }
+            d[x] = i_prev;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Palette::lookupTable(cv::Mat& lut) const
+{
+    lut = cv::Mat(1, 256, CV_8UC3, cv::Scalar(0, 0, 0));
+    for(unsigned int i = 0; i < colors_.size(); ++i)
+        lut.at<cv::Vec3b>(0, i) = colors_[i];
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Canvas::toBGR(cv::Mat& bgr) const
+{
+    if (!palette)
+    {
+        bgr = image;
+        return;
+    }
+
+    cv::Mat lut;
+    palette->lookupTable(lut);
+
+    cv::Mat indices;
+    cv::cvtColor(image, indices, CV_GRAY2BGR);
+    cv::LUT(indices, lut, bgr);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+CanvasJournal::CanvasJournal(const cv::Mat& image, int tile_size) : image_(image), tile_size_(tile_size)
+{
+    num_tiles_x_ = (image.cols + tile_size - 1) / tile_size;
+    int num_tiles_y = (image.rows + tile_size - 1) / tile_size;
+
+    originals_.resize(num_tiles_x_ * num_tiles_y);
+    changed_.resize(originals_.size(), 0);
+
+    if (check_snapshots)
+        check_copy_ = image.clone();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+cv::Rect CanvasJournal::tileRect(int i) const
+{
+    cv::Rect rect((i % num_tiles_x_) * tile_size_, (i / num_tiles_x_) * tile_size_, tile_size_, tile_size_);
+    return rect & cv::Rect(0, 0, image_.cols, image_.rows);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void CanvasJournal::record(const cv::Rect& rect)
+{
+    cv::Rect r = rect & cv::Rect(0, 0, image_.cols, image_.rows);
+    if (r.area() == 0)
+        return;
+
+    for(int ty = r.y / tile_size_; ty <= (r.y + r.height - 1) / tile_size_; ++ty)
+    {
+        for(int tx = r.x / tile_size_; tx <= (r.x + r.width - 1) / tile_size_; ++tx)
+        {
+            int i = ty * num_tiles_x_ + tx;
+            if (originals_[i].empty())
+                originals_[i] = image_(tileRect(i)).clone();
+            changed_[i] = 1;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void CanvasJournal::restore(const std::vector<boost::weak_ptr<CanvasJournal> >& journals)
+{
+    for(unsigned int i = 0; i < changed_.size(); ++i)
+    {
+        if (!changed_[i])
+            continue;
+
+        cv::Rect rect = tileRect(i);
+
+        for(unsigned int j = 0; j < journals.size(); ++j)
+        {
+            boost::shared_ptr<CanvasJournal> journal = journals[j].lock();
+            if (journal && journal.get() != this)
+                journal->record(rect);
+        }
+
+        cv::Mat roi = image_(rect);
+        originals_[i].copyTo(roi);
+        changed_[i] = 0;
+    }
+
+    if (check_copy_.empty())
+        return;
+
+    for(unsigned int i = 0; i < changed_.size(); ++i)
+    {
+        cv::Rect rect = tileRect(i);
+        if (cv::norm(image_(rect), check_copy_(rect), cv::NORM_INF) != 0)
+        {
+            std::stringstream msg;
+            msg << "CanvasJournal::restore: pixels in the tile at (" << rect.x << ", " << rect.y
+                << ") were changed without Canvas::modify()";
+            CV_Error(CV_StsError, msg.str());
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool Canvas::offsetInBuffer(cv::Point& offset) const
+{
+    const cv::Mat& b = buffer->image;
+    if (image.data < b.data || image.data >= b.data + b.rows * b.step[0])
+        return false;
+
+    std::size_t d = image.data - b.data;
+    offset = cv::Point((d % b.step[0]) / b.elemSize(), d / b.step[0]);
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Canvas::replaceBuffer()
+{
+    for(unsigned int i = 0; i < buffer->journals.size(); ++i)
+    {
+        if (!buffer->journals[i].expired())
+        {
+            std::cout << "Canvas: image was replaced while snapshots of it exist; they no longer see its changes"
+                      << std::endl;
+            break;
+        }
+    }
+
+    buffer.reset(new CanvasBuffer(image));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Canvas::record(const cv::Rect& rect)
+{
+    cv::Point offset;
+    if (!offsetInBuffer(offset))
+    {
+        // The image was replaced: the snapshots are of other pixels
+        replaceBuffer();
+        return;
+    }
+
+    cv::Rect r = rect & cv::Rect(0, 0, image.cols, image.rows);
+    if (r.area() == 0)
+        return;
+
+    r.x += offset.x;
+    r.y += offset.y;
+
+    std::vector<boost::weak_ptr<CanvasJournal> >& journals = buffer->journals;
+    for(unsigned int i = 0; i < journals.size(); )
+    {
+        boost::shared_ptr<CanvasJournal> journal = journals[i].lock();
+        if (journal)
+        {
+            journal->record(r);
+            ++i;
+        }
+        else
+        {
+            journals[i] = journals.back();
+            journals.pop_back();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+CanvasSnapshot Canvas::snapshot(int tile_size)
+{
+    cv::Point offset;
+    if (!offsetInBuffer(offset))
+        replaceBuffer();
+
+    CanvasSnapshot s;
+    s.journal_.reset(new CanvasJournal(buffer->image, tile_size));
+    buffer->journals.push_back(s.journal_);
+    return s;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Canvas::restore(const CanvasSnapshot& snapshot)
+{
+    cv::Point offset;
+    if (!snapshot.valid() || !offsetInBuffer(offset) || snapshot.journal_->image().data != buffer->image.data)
+    {
+        std::cout << "Canvas::restore: snapshot is not of this canvas" << std::endl;
+        return;
+    }
+
+    snapshot.journal_->restore(buffer->journals);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Canvas::checkSnapshots(bool check)
+{
+    check_snapshots = check;
+}
@@ -4,6 +4,9 @@
 #include <opencv2/core/core.hpp>
 #include <geolib/datatypes.h>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
 // ----------------------------------------------------------------------------------------------------
 
 struct Color
@@ -18,19 +21,175 @@ struct Color
 
 // ----------------------------------------------------------------------------------------------------
 
+// Colors of a palette canvas. Colors get an index the first time they are drawn; once all 256 indices are
+// taken, other colors get the index of the nearest color (which is reported once). Not thread-safe.
+class Palette
+{
+
+public:
+
+    Palette() : full_reported_(false) {}
+
+    int index(const cv::Scalar& color);
+
+    // Index of color 'i' blended with 'color', with opacity 'alpha' (0 - 255)
+    int blend(int i, const cv::Scalar& color, int alpha);
+
+    // Index of the nearest color, without adding 'color'
+    int nearest(const cv::Vec3b& color) const;
+
+    // Maps a CV_8UC3 image to the nearest colors of the palette
+    void quantize(const cv::Mat& bgr, cv::Mat& indices) const;
+
+    // 1 x 256 CV_8UC3, for cv::LUT
+    void lookupTable(cv::Mat& lut) const;
+
+    const std::vector<cv::Vec3b>& colors() const { return colors_; }
+
+private:
+
+    std::vector<cv::Vec3b> colors_;
+
+    bool full_reported_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Original pixels of the tiles of a canvas buffer that changed since a snapshot was taken
+class CanvasJournal
+{
+
+public:
+
+    CanvasJournal(const cv::Mat& image, int tile_size);
+
+    // 'rect' in buffer coordinates
+    void record(const cv::Rect& rect);
+
+    // Copies back the tiles changed since the snapshot or the previous restore. Other journals of the
+    // buffer are told about the change.
+    void restore(const std::vector<boost::weak_ptr<CanvasJournal> >& journals);
+
+    const cv::Mat& image() const { return image_; }
+
+private:
+
+    cv::Mat image_;
+
+    int tile_size_;
+    int num_tiles_x_;
+
+    // Empty for tiles that were never changed
+    std::vector<cv::Mat> originals_;
+
+    std::vector<unsigned char> changed_;
+
+    // Copy of the whole buffer, only when snapshots are checked (see Canvas::checkSnapshots)
+    cv::Mat check_copy_;
+
+    cv::Rect tileRect(int i) const;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// The pixels shared by a canvas, its copies and its sub-canvases, and the journals of their snapshots
+struct CanvasBuffer
+{
+    CanvasBuffer(const cv::Mat& image_) : image(image_) {}
+
+    cv::Mat image;
+
+    std::vector<boost::weak_ptr<CanvasJournal> > journals;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+class CanvasSnapshot
+{
+
+public:
+
+    bool valid() const { return journal_.get() != 0; }
+
+private:
+
+    friend struct Canvas;
+
+    boost::shared_ptr<CanvasJournal> journal_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
 struct Canvas
 {
-    Canvas(int width_, int height_, const cv::Scalar& background_color_)
-        : image(height_, width_, CV_8UC3, background_color_), background_color(background_color_), pixels_per_meter(80)
+    // With a palette, the image is CV_8UC1 and holds palette indices: a third of the memory of a BGR image.
+    // Colors are passed through ink() and anti-aliasing is off (blending would give arbitrary indices).
+    Canvas(int width_, int height_, const cv::Scalar& background_color_,
+           const boost::shared_ptr<Palette>& palette_ = boost::shared_ptr<Palette>())
+        : background_color(background_color_), pixels_per_meter(80), palette(palette_)
     {
+        image = cv::Mat(height_, width_, palette ? CV_8UC1 : CV_8UC3, ink(background_color));
+        buffer.reset(new CanvasBuffer(image));
         center = 0.5 * cv::Point(image.cols, image.rows);
     }
 
     void clear()
     {
-        image.setTo(background_color);
+        modify();
+        image.setTo(ink(background_color));
+    }
+
+    // What to draw into 'image' for 'color': the color itself, or its palette index. The palette is shared
+    // with copies and sub-canvases of this canvas, so they can not get ink in parallel.
+    cv::Scalar ink(const cv::Scalar& color) const
+    {
+        return palette ? cv::Scalar(palette->index(color)) : color;
+    }
+
+    int lineType(int line_type = CV_AA) const
+    {
+        return (palette && line_type == CV_AA) ? 8 : line_type;
     }
 
+    // The image as BGR (shares the pixels if the canvas has no palette)
+    void toBGR(cv::Mat& bgr) const;
+
+    // Snapshots are taken for free: the original pixels of a tile are only copied the first time it is
+    // modified afterwards. restore() copies back the tiles that were modified since the snapshot (or since
+    // the previous restore of that snapshot), so a snapshot can be restored any number of times. A
+    // snapshot covers the whole buffer, also when taken from a sub-canvas.
+    CanvasSnapshot snapshot(int tile_size = 64);
+
+    void restore(const CanvasSnapshot& snapshot);
+
+    // For tests and debugging: snapshots taken from now on keep a full copy of the buffer, and restore()
+    // throws a cv::Exception if the restored image differs from it, i.e. if something changed the pixels
+    // without calling modify(). Not thread-safe; set it before taking snapshots.
+    static void checkSnapshots(bool check = true);
+
+    // Snapshots only see changes announced with modify() (in image coordinates), before drawing. The
+    // drawing helpers do this themselves; code that draws into 'image' directly has to do it too. Assigning
+    // other pixels to 'image' detaches the canvas from its snapshots (which is reported).
+    void modify(const cv::Rect& rect)
+    {
+        if (!buffer->journals.empty())
+            record(rect);
+    }
+
+    // Box spanned by two points, grown by 'margin' pixels (e.g. a line and its thickness)
+    void modify(const cv::Point& p1, const cv::Point& p2, int margin)
+    {
+        modify(cv::Rect(std::min(p1.x, p2.x) - margin, std::min(p1.y, p2.y) - margin,
+                        std::abs(p1.x - p2.x) + 2 * margin + 1, std::abs(p1.y - p2.y) + 2 * margin + 1));
+    }
+
+    void modify(const cv::Point& p, int radius) { modify(p, p, radius); }
+
+    void modify() { modify(cv::Rect(0, 0, image.cols, image.rows)); }
+
     cv::Point worldToImage(const geo::Vec2& p_world) const
     {
         return cv::Point(p_world.x * pixels_per_meter + center.x,
@@ -59,14 +218,18 @@ struct Canvas
         int wp = width * image.cols;
         int hp = height * image.cols;
 
-        Canvas sub(wp, hp, background_color);
+        Canvas sub(wp, hp, background_color, palette);
         sub.image = image(cv::Rect(xp, yp, wp, hp));
+        sub.buffer = buffer;
         sub.clear();
 
         int border = 10;
-        cv::Mat roi = image(cv::Rect(xp - border, yp - border, wp + border * 2, hp + border * 2));
-        roi.setTo(background_color);
-        cv::rectangle(roi, cv::Point(border / 2, border / 2), cv::Point(roi.cols - border / 2, roi.rows - border / 2), cv::Scalar(100, 100, 100), 2);
+        cv::Rect roi_rect(xp - border, yp - border, wp + border * 2, hp + border * 2);
+        modify(roi_rect);
+
+        cv::Mat roi = image(roi_rect);
+        roi.setTo(ink(background_color));
+        cv::rectangle(roi, cv::Point(border / 2, border / 2), cv::Point(roi.cols - border / 2, roi.rows - border / 2), ink(cv::Scalar(100, 100, 100)), 2);
 
         return sub;
     }
@@ -81,6 +244,22 @@ struct Canvas
 
     double pixels_per_meter;
     cv::Point center;
+
+    // Shared by the canvases that are written with the same colors
+    boost::shared_ptr<Palette> palette;
+
+    boost::shared_ptr<CanvasBuffer> buffer;
+
+private:
+
+    void record(const cv::Rect& rect);
+
+    // Position of 'image' in the buffer, false if 'image' was replaced by other pixels
+    bool offsetInBuffer(cv::Point& offset) const;
+
+    // Starts a new buffer for 'image' after it was replaced
+    void replaceBuffer();
+
 };
 
 #endif
@@ -14,6 +14,9 @@ int main(int argc, char **argv)
 
     bool show = false;
 
+    // Draw palette indices instead of BGR (a third of the memory, smaller PNGs, but no anti-aliasing)
+    bool palette = false;
+
     if (!show && argc > 1)
     {
         iw.setWritePath(argv[1]);
@@ -27,6 +30,7 @@ int main(int argc, char **argv)
     }
 
     iw.setShow(show);
+    iw.setPaletteMode(palette);
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
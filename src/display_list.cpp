@@ -0,0 +1,341 @@
+#include "display_list.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <climits>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+typedef DisplayList::Command Command;
+
+bool sameStyle(const Command& c1, const Command& c2)
+{
+    return c1.color.color == c2.color.color && c1.color.thickness == c2.color.thickness
+            && c1.line_type == c2.line_type && c1.closed == c2.closed;
+}
+
+// Consecutive polylines of the same style, drawn with one cv::polylines call
+class PolylineBatch
+{
+
+public:
+
+    PolylineBatch(Canvas& canvas) : canvas_(canvas), style_(0) {}
+
+    void add(const Command& c, const std::vector<cv::Point>& points)
+    {
+        if (style_ && !sameStyle(*style_, c))
+            flush();
+
+        style_ = &c;
+        points_.insert(points_.end(), points.begin(), points.end());
+        counts_.push_back(points.size());
+    }
+
+    void flush()
+    {
+        if (counts_.empty())
+            return;
+
+        contours_.resize(counts_.size());
+        const cv::Point* p = &points_[0];
+        for(unsigned int i = 0; i < counts_.size(); ++i)
+        {
+            contours_[i] = p;
+            p += counts_[i];
+        }
+
+        cv::polylines(canvas_.image, &contours_[0], &counts_[0], counts_.size(), style_->closed, canvas_.ink(style_->color.color),
+                      style_->color.thickness, canvas_.lineType(style_->line_type));
+
+        points_.clear();
+        counts_.clear();
+        style_ = 0;
+    }
+
+private:
+
+    Canvas& canvas_;
+
+    const Command* style_;
+
+    std::vector<cv::Point> points_;
+    std::vector<int> counts_;
+    std::vector<const cv::Point*> contours_;
+
+};
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+DisplayList::Command& DisplayList::addCommand(CommandType type, const Color& color, int line_type)
+{
+    commands_.push_back(Command());
+    Command& c = commands_.back();
+    c.type = type;
+    c.color = color;
+    c.line_type = line_type;
+    c.i_points = points_.size();
+    c.num_points = 0;
+    c.closed = false;
+    c.size = geo::Vec2(0, 0);
+    c.angle = 0;
+    c.i_image = -1;
+    return c;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::addLine(const geo::Vec2& p1, const geo::Vec2& p2, const Color& color, int line_type)
+{
+    Command& c = addCommand(POLYLINE, color, line_type);
+    c.num_points = 2;
+    points_.push_back(p1);
+    points_.push_back(p2);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::addPolyline(const std::vector<geo::Vec2>& points, bool closed, const Color& color, int line_type)
+{
+    if (points.empty())
+        return;
+
+    Command& c = addCommand(POLYLINE, color, line_type);
+    c.num_points = points.size();
+    c.closed = closed;
+    points_.insert(points_.end(), points.begin(), points.end());
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::addCircle(const geo::Vec2& center, double radius, const Color& color, int line_type)
+{
+    Command& c = addCommand(CIRCLE, color, line_type);
+    c.num_points = 1;
+    c.size = geo::Vec2(radius, radius);
+    points_.push_back(center);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::addEllipse(const geo::Vec2& center, const geo::Vec2& axes, double angle, const Color& color, int line_type)
+{
+    Command& c = addCommand(ELLIPSE, color, line_type);
+    c.num_points = 1;
+    c.size = axes;
+    c.angle = angle;
+    points_.push_back(center);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::addRectangle(const geo::Vec2& p1, const geo::Vec2& p2, const Color& color)
+{
+    Command& c = addCommand(RECTANGLE, color, 8);
+    c.num_points = 2;
+    points_.push_back(p1);
+    points_.push_back(p2);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::addImage(const cv::Mat& image, const geo::Vec2& p1, const geo::Vec2& p2)
+{
+    Command& c = addCommand(IMAGE, Color(0, 0, 0, 0), 8);
+    c.num_points = 2;
+    c.i_image = images_.size();
+    points_.push_back(p1);
+    points_.push_back(p2);
+    images_.push_back(image);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::addModel(const Model2D& m, const geo::Transform2& pose, const Color& color)
+{
+    for(std::vector<Contour2D>::const_iterator it = m.contours.begin(); it != m.contours.end(); ++it)
+    {
+        const Contour2D& contour = *it;
+        if (contour.points.empty())
+            continue;
+
+        Command& c = addCommand(POLYLINE, color, CV_AA);
+        c.num_points = contour.points.size();
+        c.closed = true;
+
+        for(unsigned int j = 0; j < contour.points.size(); ++j)
+            points_.push_back(pose * contour.points[j]);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::addWorld(const WorldModel2D& wm)
+{
+    wm.updatePoses();
+
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
+    {
+        const Entity2D& e = wm.entities()[i];
+        addModel(*e.shape, e.pose(), e.color);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::append(const DisplayList& list)
+{
+    int point_offset = points_.size();
+    int image_offset = images_.size();
+
+    for(unsigned int i = 0; i < list.commands_.size(); ++i)
+    {
+        commands_.push_back(list.commands_[i]);
+        Command& c = commands_.back();
+        c.i_points += point_offset;
+        if (c.i_image >= 0)
+            c.i_image += image_offset;
+    }
+
+    points_.insert(points_.end(), list.points_.begin(), list.points_.end());
+    images_.insert(images_.end(), list.images_.begin(), list.images_.end());
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::clear()
+{
+    commands_.clear();
+    points_.clear();
+    images_.clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+cv::Rect DisplayList::boundingBox(int i, const Canvas& canvas) const
+{
+    const Command& c = commands_[i];
+
+    cv::Point p_min(INT_MAX, INT_MAX);
+    cv::Point p_max(INT_MIN, INT_MIN);
+    for(int j = c.i_points; j < c.i_points + c.num_points; ++j)
+    {
+        cv::Point p = canvas.worldToImage(points_[j]);
+        p_min.x = std::min(p_min.x, p.x);
+        p_min.y = std::min(p_min.y, p.y);
+        p_max.x = std::max(p_max.x, p.x);
+        p_max.y = std::max(p_max.y, p.y);
+    }
+
+    // Thick lines are drawn with round caps, anti-aliasing adds another pixel
+    int margin = std::max(c.color.thickness, 0) + 1;
+    if (c.type == CIRCLE || c.type == ELLIPSE)
+        margin += cvRound(std::max(c.size.x, c.size.y) * canvas.pixels_per_meter);
+    else if (c.type == IMAGE)
+        margin = 0;
+
+    return cv::Rect(p_min.x - margin, p_min.y - margin, p_max.x - p_min.x + 2 * margin + 1, p_max.y - p_min.y + 2 * margin + 1);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::draw(Canvas& canvas) const
+{
+    std::vector<int> commands(commands_.size());
+    for(unsigned int i = 0; i < commands.size(); ++i)
+        commands[i] = i;
+
+    draw(canvas, commands);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DisplayList::draw(Canvas& canvas, const std::vector<int>& commands, const cv::Point& offset) const
+{
+    cv::Rect image_rect(0, 0, canvas.image.cols, canvas.image.rows);
+
+    PolylineBatch batch(canvas);
+    std::vector<cv::Point> points;
+
+    for(unsigned int k = 0; k < commands.size(); ++k)
+    {
+        const Command& c = commands_[commands[k]];
+
+        cv::Rect bb = boundingBox(commands[k], canvas) - offset;
+        if ((bb & image_rect).area() == 0)
+            continue;
+
+        canvas.modify(bb);
+
+        points.resize(c.num_points);
+        for(int j = 0; j < c.num_points; ++j)
+            points[j] = canvas.worldToImage(points_[c.i_points + j]) - offset;
+
+        if (c.type == POLYLINE)
+        {
+            batch.add(c, points);
+            continue;
+        }
+
+        batch.flush();
+
+        if (c.type == CIRCLE)
+        {
+            int radius = cvRound(c.size.x * canvas.pixels_per_meter);
+            cv::circle(canvas.image, points[0], radius, canvas.ink(c.color.color), c.color.thickness, canvas.lineType(c.line_type));
+        }
+        else if (c.type == ELLIPSE)
+        {
+            cv::Size axes(cvRound(c.size.x * canvas.pixels_per_meter), cvRound(c.size.y * canvas.pixels_per_meter));
+            cv::ellipse(canvas.image, points[0], axes, c.angle / M_PI * 180, 0, 360, canvas.ink(c.color.color), c.color.thickness,
+                        canvas.lineType(c.line_type));
+        }
+        else if (c.type == RECTANGLE)
+        {
+            cv::rectangle(canvas.image, points[0], points[1], canvas.ink(c.color.color), c.color.thickness, c.line_type);
+        }
+        else if (c.type == IMAGE)
+        {
+            cv::Rect rect(cv::Point(std::min(points[0].x, points[1].x), std::min(points[0].y, points[1].y)),
+                          cv::Point(std::max(points[0].x, points[1].x), std::max(points[0].y, points[1].y)));
+
+            cv::Rect visible = rect & image_rect;
+            if (visible.area() == 0)
+                continue;
+
+            // Only resamples the visible part, with the mapping of scaling the whole image to 'rect' (like
+            // cv::resize), so the parts of an image drawn in strips fit together
+            const cv::Mat& image = images_[c.i_image];
+            double sx = (double)image.cols / rect.width;
+            double sy = (double)image.rows / rect.height;
+            cv::Point v = visible.tl() - rect.tl();
+
+            cv::Mat image_to_visible(2, 3, CV_64F, cv::Scalar(0));
+            image_to_visible.at<double>(0, 0) = sx;
+            image_to_visible.at<double>(0, 2) = sx * (v.x + 0.5) - 0.5;
+            image_to_visible.at<double>(1, 1) = sy;
+            image_to_visible.at<double>(1, 2) = sy * (v.y + 0.5) - 0.5;
+
+            cv::Mat image_resized;
+            cv::warpAffine(image, image_resized, image_to_visible, visible.size(), cv::INTER_LINEAR | cv::WARP_INVERSE_MAP,
+                           cv::BORDER_REPLICATE);
+
+            if (canvas.palette)
+            {
+                cv::Mat indices;
+                canvas.palette->quantize(image_resized, indices);
+                image_resized = indices;
+            }
+
+            cv::Mat roi = canvas.image(visible);
+            image_resized.copyTo(roi);
+        }
+    }
+
+    batch.flush();
+}
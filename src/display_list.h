@@ -0,0 +1,100 @@
+#ifndef _DISPLAY_LIST_H_
+#define _DISPLAY_LIST_H_
+
+#include "world_model.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+// Drawing commands recorded in world coordinates, so that a scene can be built once and drawn onto
+// any canvas, at any scale, as often as needed. Sizes (radii, ellipse axes) are in meters, line
+// thicknesses in pixels like everywhere else; a negative thickness (CV_FILLED) fills circles,
+// ellipses and rectangles. Consecutive lines and polylines of the same style are drawn with a single
+// cv::polylines call, and commands that can not touch the image are skipped.
+
+class DisplayList
+{
+
+public:
+
+    enum CommandType
+    {
+        POLYLINE,
+        CIRCLE,
+        ELLIPSE,
+        RECTANGLE,
+        IMAGE
+    };
+
+    struct Command
+    {
+        CommandType type;
+        Color color;
+        int line_type;
+
+        // Polyline points, the center of circles and ellipses or the corners of rectangles and images
+        int i_points;
+        int num_points;
+        bool closed;
+
+        // Circle radius or ellipse axes (m)
+        geo::Vec2 size;
+
+        // Ellipse rotation (rad)
+        double angle;
+
+        int i_image;
+    };
+
+    void addLine(const geo::Vec2& p1, const geo::Vec2& p2, const Color& color, int line_type = CV_AA);
+
+    void addPolyline(const std::vector<geo::Vec2>& points, bool closed, const Color& color, int line_type = CV_AA);
+
+    void addCircle(const geo::Vec2& center, double radius, const Color& color, int line_type = CV_AA);
+
+    void addEllipse(const geo::Vec2& center, const geo::Vec2& axes, double angle, const Color& color, int line_type = CV_AA);
+
+    void addRectangle(const geo::Vec2& p1, const geo::Vec2& p2, const Color& color);
+
+    // Scaled to fit the rectangle from p1 to p2. The image is shared, not copied. On palette canvases it
+    // is drawn in the nearest palette colors.
+    void addImage(const cv::Mat& image, const geo::Vec2& p1, const geo::Vec2& p2);
+
+    // One closed polyline per contour
+    void addModel(const Model2D& m, const geo::Transform2& pose, const Color& color);
+
+    void addWorld(const WorldModel2D& wm);
+
+    void append(const DisplayList& list);
+
+    void draw(Canvas& canvas) const;
+
+    // Only draws the given commands (in the given order). 'offset' is the position of the canvas image in a
+    // larger image that 'canvas.center' refers to, for drawing that image in parts (shifting 'center'
+    // instead rounds differently). Commands that lie within a part get the same pixels as when drawing the
+    // image as a whole; lines crossing the border of a part are clipped there, which can move pixels.
+    void draw(Canvas& canvas, const std::vector<int>& commands, const cv::Point& offset = cv::Point(0, 0)) const;
+
+    // Image area the command can touch (not clipped to the image)
+    cv::Rect boundingBox(int i, const Canvas& canvas) const;
+
+    void clear();
+
+    unsigned int size() const { return commands_.size(); }
+
+    bool empty() const { return commands_.empty(); }
+
+    const Command& command(int i) const { return commands_[i]; }
+
+private:
+
+    std::vector<Command> commands_;
+
+    std::vector<geo::Vec2> points_;
+
+    std::vector<cv::Mat> images_;
+
+    Command& addCommand(CommandType type, const Color& color, int line_type);
+
+};
+
+#endif
@@ -0,0 +1,411 @@
+#include "evidence_grid.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <cmath>
+#include <algorithm>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+// Floor division, also for negative cell indices
+int tileIndex(int c)
+{
+    return c >= 0 ? c / EvidenceGrid::TILE_SIZE : -((-c - 1) / EvidenceGrid::TILE_SIZE) - 1;
+}
+
+// Amanatides & Woo grid traversal. Calls f(cx, cy, false) for every cell from p1 up to the cell
+// containing p2, and f(cx, cy, true) for the cell containing p2.
+template<typename F>
+void traverseRay(const geo::Vec2& p1, const geo::Vec2& p2, double resolution, F& f)
+{
+    double x1 = p1.x / resolution;
+    double y1 = p1.y / resolution;
+    double x2 = p2.x / resolution;
+    double y2 = p2.y / resolution;
+
+    int cx = floor(x1);
+    int cy = floor(y1);
+    int ex = floor(x2);
+    int ey = floor(y2);
+
+    double dx = x2 - x1;
+    double dy = y2 - y1;
+
+    int step_x = dx > 0 ? 1 : -1;
+    int step_y = dy > 0 ? 1 : -1;
+
+    double t_delta_x = dx != 0 ? 1.0 / std::abs(dx) : 1e30;
+    double t_delta_y = dy != 0 ? 1.0 / std::abs(dy) : 1e30;
+
+    double t_max_x = dx != 0 ? (step_x > 0 ? cx + 1 - x1 : x1 - cx) * t_delta_x : 1e30;
+    double t_max_y = dy != 0 ? (step_y > 0 ? cy + 1 - y1 : y1 - cy) * t_delta_y : 1e30;
+
+    int n = std::abs(ex - cx) + std::abs(ey - cy);
+
+    for(int k = 0; k < n; ++k)
+    {
+        f(cx, cy, false);
+
+        if (t_max_x < t_max_y)
+        {
+            cx += step_x;
+            t_max_x += t_delta_x;
+        }
+        else
+        {
+            cy += step_y;
+            t_max_y += t_delta_y;
+        }
+    }
+
+    f(cx, cy, true);
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Applies ray updates directly, only looking up a tile when the ray enters it
+class EvidenceGrid::RayUpdater
+{
+
+public:
+
+    RayUpdater(EvidenceGrid& grid, float delta_free, float delta_end)
+        : grid_(grid), delta_free_(delta_free), delta_end_(delta_end), tile_(0) {}
+
+    void operator()(int cx, int cy, bool is_end)
+    {
+        int tx = tileIndex(cx);
+        int ty = tileIndex(cy);
+        if (!tile_ || tile_->tx != tx || tile_->ty != ty)
+            tile_ = grid_.getTile(tx, ty);
+
+        float& v = tile_->cells[(cy - ty * TILE_SIZE) * TILE_SIZE + (cx - tx * TILE_SIZE)];
+        v = std::max(grid_.min_log_odds_, std::min(grid_.max_log_odds_, v + (is_end ? delta_end_ : delta_free_)));
+    }
+
+private:
+
+    EvidenceGrid& grid_;
+    float delta_free_;
+    float delta_end_;
+    Tile* tile_;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+class EvidenceGrid::RayTracer
+{
+
+public:
+
+    RayTracer(std::vector<CellUpdate>& updates, float delta_free, float delta_end)
+        : updates_(updates), delta_free_(delta_free), delta_end_(delta_end) {}
+
+    void operator()(int cx, int cy, bool is_end)
+    {
+        CellUpdate u;
+        u.cx = cx;
+        u.cy = cy;
+        u.delta = is_end ? delta_end_ : delta_free_;
+        updates_.push_back(u);
+    }
+
+private:
+
+    std::vector<CellUpdate>& updates_;
+    float delta_free_;
+    float delta_end_;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+EvidenceGrid::EvidenceGrid(double resolution, int max_tiles)
+    : resolution_(resolution), max_tiles_(max_tiles), min_log_odds_(-5), max_log_odds_(5), stamp_(0), last_tile_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+EvidenceGrid::~EvidenceGrid()
+{
+    clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void EvidenceGrid::clear()
+{
+    for(unsigned int i = 0; i < tiles_.size(); ++i)
+        delete tiles_[i];
+    tiles_.clear();
+    tile_index_.clear();
+    last_tile_ = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void EvidenceGrid::setLimits(float min_log_odds, float max_log_odds)
+{
+    min_log_odds_ = min_log_odds;
+    max_log_odds_ = max_log_odds;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+EvidenceGrid::Tile* EvidenceGrid::getTile(int tx, int ty)
+{
+    if (last_tile_ && last_tile_->tx == tx && last_tile_->ty == ty)
+        return last_tile_;
+
+    std::pair<int, int> key(tx, ty);
+
+    std::map<std::pair<int, int>, int>::const_iterator it = tile_index_.find(key);
+    if (it != tile_index_.end())
+    {
+        last_tile_ = tiles_[it->second];
+        last_tile_->last_used = ++stamp_;
+        return last_tile_;
+    }
+
+    int i_tile;
+    if (max_tiles_ > 0 && (int)tiles_.size() >= max_tiles_)
+    {
+        // Re-use the least recently used tile
+        i_tile = 0;
+        for(unsigned int i = 1; i < tiles_.size(); ++i)
+        {
+            if (tiles_[i]->last_used < tiles_[i_tile]->last_used)
+                i_tile = i;
+        }
+
+        tile_index_.erase(std::make_pair(tiles_[i_tile]->tx, tiles_[i_tile]->ty));
+    }
+    else
+    {
+        i_tile = tiles_.size();
+        tiles_.push_back(new Tile);
+    }
+
+    Tile* t = tiles_[i_tile];
+    t->tx = tx;
+    t->ty = ty;
+    t->last_used = ++stamp_;
+    std::fill(t->cells, t->cells + TILE_SIZE * TILE_SIZE, 0.0f);
+
+    tile_index_[key] = i_tile;
+    last_tile_ = t;
+
+    return t;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+float& EvidenceGrid::cell(int cx, int cy)
+{
+    int tx = tileIndex(cx);
+    int ty = tileIndex(cy);
+    Tile* t = getTile(tx, ty);
+    return t->cells[(cy - ty * TILE_SIZE) * TILE_SIZE + (cx - tx * TILE_SIZE)];
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void EvidenceGrid::toCell(const geo::Vec2& p, int& cx, int& cy) const
+{
+    cx = floor(p.x / resolution_);
+    cy = floor(p.y / resolution_);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void EvidenceGrid::updateCell(const geo::Vec2& p, float delta)
+{
+    int cx, cy;
+    toCell(p, cx, cy);
+
+    float& v = cell(cx, cy);
+    v = std::max(min_log_odds_, std::min(max_log_odds_, v + delta));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void EvidenceGrid::updateRay(const geo::Vec2& p1, const geo::Vec2& p2, float delta_free, float delta_end)
+{
+    RayUpdater updater(*this, delta_free, delta_end);
+    traverseRay(p1, p2, resolution_, updater);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void EvidenceGrid::traceRay(const geo::Vec2& p1, const geo::Vec2& p2, float delta_free, float delta_end,
+                            std::vector<CellUpdate>& updates) const
+{
+    RayTracer tracer(updates, delta_free, delta_end);
+    traverseRay(p1, p2, resolution_, tracer);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+class ApplyTileUpdates : public cv::ParallelLoopBody
+{
+
+public:
+
+    ApplyTileUpdates(const std::vector<EvidenceGrid::CellUpdate>& updates, const std::vector<EvidenceGrid::Tile*>& tiles,
+                     const std::vector<std::vector<int> >& tile_updates, float min_log_odds, float max_log_odds)
+        : updates_(updates), tiles_(tiles), tile_updates_(tile_updates), min_log_odds_(min_log_odds), max_log_odds_(max_log_odds) {}
+
+    void operator()(const cv::Range& r) const
+    {
+        for(int i = r.start; i < r.end; ++i)
+        {
+            EvidenceGrid::Tile& t = *tiles_[i];
+            const std::vector<int>& indices = tile_updates_[i];
+
+            for(unsigned int j = 0; j < indices.size(); ++j)
+            {
+                const EvidenceGrid::CellUpdate& u = updates_[indices[j]];
+                float& v = t.cells[(u.cy - t.ty * EvidenceGrid::TILE_SIZE) * EvidenceGrid::TILE_SIZE + (u.cx - t.tx * EvidenceGrid::TILE_SIZE)];
+                v = std::max(min_log_odds_, std::min(max_log_odds_, v + u.delta));
+            }
+        }
+    }
+
+private:
+
+    const std::vector<EvidenceGrid::CellUpdate>& updates_;
+    const std::vector<EvidenceGrid::Tile*>& tiles_;
+    const std::vector<std::vector<int> >& tile_updates_;
+    float min_log_odds_;
+    float max_log_odds_;
+};
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void EvidenceGrid::applyUpdates(const std::vector<CellUpdate>& updates)
+{
+    // Bin the updates per tile, keeping their order
+    std::map<std::pair<int, int>, int> batch_index;
+    std::vector<std::pair<int, int> > batch_keys;
+    std::vector<std::vector<int> > tile_updates;
+
+    for(unsigned int i = 0; i < updates.size(); ++i)
+    {
+        std::pair<int, int> key(tileIndex(updates[i].cx), tileIndex(updates[i].cy));
+
+        std::map<std::pair<int, int>, int>::iterator it = batch_index.find(key);
+        if (it == batch_index.end())
+        {
+            it = batch_index.insert(std::make_pair(key, (int)batch_keys.size())).first;
+            batch_keys.push_back(key);
+            tile_updates.push_back(std::vector<int>());
+        }
+
+        tile_updates[it->second].push_back(i);
+    }
+
+    if (max_tiles_ > 0 && (int)batch_keys.size() > max_tiles_)
+    {
+        // Tiles of this batch would evict each other: apply one by one
+        for(unsigned int i = 0; i < updates.size(); ++i)
+        {
+            float& v = cell(updates[i].cx, updates[i].cy);
+            v = std::max(min_log_odds_, std::min(max_log_odds_, v + updates[i].delta));
+        }
+        return;
+    }
+
+    // Allocating tiles is not thread-safe, so do it up front
+    std::vector<Tile*> batch_tiles(batch_keys.size());
+    for(unsigned int i = 0; i < batch_keys.size(); ++i)
+        batch_tiles[i] = getTile(batch_keys[i].first, batch_keys[i].second);
+
+    cv::parallel_for_(cv::Range(0, batch_tiles.size()),
+                      ApplyTileUpdates(updates, batch_tiles, tile_updates, min_log_odds_, max_log_odds_));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+float EvidenceGrid::logOdds(const geo::Vec2& p) const
+{
+    int cx, cy;
+    toCell(p, cx, cy);
+
+    int tx = tileIndex(cx);
+    int ty = tileIndex(cy);
+
+    std::map<std::pair<int, int>, int>::const_iterator it = tile_index_.find(std::make_pair(tx, ty));
+    if (it == tile_index_.end())
+        return 0;
+
+    return tiles_[it->second]->cells[(cy - ty * TILE_SIZE) * TILE_SIZE + (cx - tx * TILE_SIZE)];
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void EvidenceGrid::getCellsAbove(float threshold, std::vector<geo::Vec2>& points) const
+{
+    for(unsigned int i = 0; i < tiles_.size(); ++i)
+    {
+        const Tile& t = *tiles_[i];
+        for(int y = 0; y < TILE_SIZE; ++y)
+        {
+            const float* row = t.cells + y * TILE_SIZE;
+            for(int x = 0; x < TILE_SIZE; ++x)
+            {
+                if (row[x] > threshold)
+                    points.push_back(cellCenter(t, x, y));
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void integrateChanges(EvidenceGrid& grid, const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose,
+                      const std::vector<double>& ranges_virtual, const std::vector<double>& ranges_real,
+                      const ChangeDetectionParameters& params)
+{
+    unsigned int num_beams = std::min(ranges_virtual.size(), ranges_real.size());
+
+    for(unsigned int i = 0; i < num_beams; ++i)
+    {
+        double rr = ranges_real[i];
+        if (rr <= 0)
+            continue;
+
+        double rv = ranges_virtual[i];
+
+        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+        geo::Vec2 p_end = lrf_pose * geo::Vec2(rr * ray_dir.x, rr * ray_dir.y);
+
+        if (rv <= 0 || rr < rv - params.min_range_difference)
+        {
+            // Unexpected return
+            grid.updateRay(lrf_pose.t, p_end, params.log_odds_free, params.log_odds_hit);
+        }
+        else
+        {
+            // Explained by the world model; the end point itself is the known world, so leave it alone
+            grid.updateRay(lrf_pose.t, p_end, params.log_odds_free, 0);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void detectChanges(const EvidenceGrid& grid, std::vector<geo::Vec2>& points, const ChangeDetectionParameters& params)
+{
+    points.clear();
+    grid.getCellsAbove(params.threshold, points);
+}
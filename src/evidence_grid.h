@@ -0,0 +1,135 @@
+#ifndef _EVIDENCE_GRID_H_
+#define _EVIDENCE_GRID_H_
+
+#include <geolib/datatypes.h>
+#include <geolib/sensors/LaserRangeFinder.h>
+
+#include <map>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Log-odds grid in world coordinates. Cells are stored in square tiles of TILE_SIZE x TILE_SIZE cells
+// (row-major, contiguous) that are allocated when first written. If max_tiles > 0, the least recently
+// used tile is dropped when a new one is needed, so memory stays bounded on long runs.
+
+class EvidenceGrid
+{
+
+public:
+
+    static const int TILE_SIZE = 64;
+
+    struct Tile
+    {
+        int tx;
+        int ty;
+        unsigned long last_used;
+        float cells[TILE_SIZE * TILE_SIZE];
+    };
+
+    EvidenceGrid(double resolution = 0.05, int max_tiles = 0);
+
+    ~EvidenceGrid();
+
+    void clear();
+
+    void setLimits(float min_log_odds, float max_log_odds);
+
+    // Adds delta_free to all cells on the line from p1 to p2, except the cell containing p2, which gets
+    // delta_end
+    void updateRay(const geo::Vec2& p1, const geo::Vec2& p2, float delta_free, float delta_end);
+
+    void updateCell(const geo::Vec2& p, float delta);
+
+    struct CellUpdate
+    {
+        int cx;
+        int cy;
+        float delta;
+    };
+
+    // Appends the updates updateRay() would do, without applying them
+    void traceRay(const geo::Vec2& p1, const geo::Vec2& p2, float delta_free, float delta_end,
+                  std::vector<CellUpdate>& updates) const;
+
+    // Applies the updates in order. Tiles are updated in parallel; since every cell is only touched by
+    // the worker of its tile, the result is the same as applying them one by one.
+    void applyUpdates(const std::vector<CellUpdate>& updates);
+
+    // Log-odds of the cell containing p; 0 (unknown) for cells that were never written
+    float logOdds(const geo::Vec2& p) const;
+
+    // Centers of all cells with a log-odds above the threshold
+    void getCellsAbove(float threshold, std::vector<geo::Vec2>& points) const;
+
+    double resolution() const { return resolution_; }
+
+    int numTiles() const { return tiles_.size(); }
+
+    const std::vector<Tile*>& tiles() const { return tiles_; }
+
+    // Center of cell (x, y) of tile t
+    geo::Vec2 cellCenter(const Tile& t, int x, int y) const
+    {
+        return geo::Vec2(((t.tx * TILE_SIZE + x) + 0.5) * resolution_, ((t.ty * TILE_SIZE + y) + 0.5) * resolution_);
+    }
+
+private:
+
+    double resolution_;
+
+    int max_tiles_;
+
+    float min_log_odds_;
+    float max_log_odds_;
+
+    std::vector<Tile*> tiles_;
+
+    std::map<std::pair<int, int>, int> tile_index_;
+
+    unsigned long stamp_;
+
+    // Last tile accessed by updates; rays mostly stay within the same tile
+    Tile* last_tile_;
+
+    class RayUpdater;
+    class RayTracer;
+
+    Tile* getTile(int tx, int ty);
+
+    float& cell(int cx, int cy);
+
+    void toCell(const geo::Vec2& p, int& cx, int& cy) const;
+
+    // Non-copyable
+    EvidenceGrid(const EvidenceGrid&);
+    EvidenceGrid& operator=(const EvidenceGrid&);
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+struct ChangeDetectionParameters
+{
+    ChangeDetectionParameters() : min_range_difference(0.1), log_odds_hit(0.85f), log_odds_free(-0.4f), threshold(2.5f) {}
+
+    // A real beam is unexpected if it is this much shorter than the virtual beam
+    double min_range_difference;
+
+    float log_odds_hit;
+    float log_odds_free;
+
+    // Cells are reported as (part of) a new object once their log-odds exceed this
+    float threshold;
+};
+
+// Accumulates evidence of objects that are not in the world model: end points of real beams that are
+// shorter than expected count as hits, cells the real beams pass through count as free.
+void integrateChanges(EvidenceGrid& grid, const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose,
+                      const std::vector<double>& ranges_virtual, const std::vector<double>& ranges_real,
+                      const ChangeDetectionParameters& params = ChangeDetectionParameters());
+
+void detectChanges(const EvidenceGrid& grid, std::vector<geo::Vec2>& points,
+                   const ChangeDetectionParameters& params = ChangeDetectionParameters());
+
+#endif
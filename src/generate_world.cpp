@@ -0,0 +1,76 @@
+#include "world_generator.h"
+#include "world_file.h"
+
+#include <cstdlib>
+#include <iostream>
+
+// ----------------------------------------------------------------------------------------------------
+
+void showUsage()
+{
+    std::cout << "Usage: generate-world office|warehouse|clutter OUTPUT_FILE [WIDTH HEIGHT [DENSITY [SEED]]]" << std::endl;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        showUsage();
+        return 1;
+    }
+
+    WorldGeneratorParameters params;
+    if (!parseWorldType(argv[1], params.type))
+    {
+        std::cout << "Unknown world type: " << argv[1] << std::endl;
+        showUsage();
+        return 1;
+    }
+
+    std::string filename = argv[2];
+
+    // Width and height only come together
+    if (argc == 4)
+    {
+        showUsage();
+        return 1;
+    }
+
+    if (argc > 4)
+    {
+        params.width = atof(argv[3]);
+        params.height = atof(argv[4]);
+
+        if (params.width < MIN_WORLD_SIZE || params.height < MIN_WORLD_SIZE)
+        {
+            std::cout << "World must be at least " << MIN_WORLD_SIZE << " x " << MIN_WORLD_SIZE << " m" << std::endl;
+            return 1;
+        }
+    }
+
+    if (argc > 5)
+        params.density = atof(argv[5]);
+
+    if (argc > 6)
+        params.seed = atoi(argv[6]);
+
+    WorldModel2D wm;
+    generateWorld(params, wm);
+
+    unsigned int num_points = 0;
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
+    {
+        const std::vector<Contour2D>& contours = wm.entities()[i].shape->contours;
+        for(unsigned int j = 0; j < contours.size(); ++j)
+            num_points += contours[j].points.size();
+    }
+
+    if (!writeWorldFile(filename, wm))
+        return 1;
+
+    std::cout << filename << ": " << wm.entities().size() << " entities, " << num_points << " vertices" << std::endl;
+
+    return 0;
+}
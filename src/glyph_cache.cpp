@@ -0,0 +1,103 @@
+#include "glyph_cache.h"
+
+#include "blend.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+// ----------------------------------------------------------------------------------------------------
+
+GlyphCache::GlyphCache(int num_headings) : num_headings_(num_headings)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+const GlyphCache::Glyph& GlyphCache::glyph(const Model2DConstPtr& model, double pixels_per_meter, int thickness, double heading)
+{
+    int i_heading = cvRound(heading / (2 * M_PI) * num_headings_) % num_headings_;
+    if (i_heading < 0)
+        i_heading += num_headings_;
+
+    GlyphKey key;
+    key.model = model.get();
+    key.pixels_per_meter = pixels_per_meter;
+    key.thickness = thickness;
+    key.i_heading = i_heading;
+
+    std::map<GlyphKey, Glyph>::iterator it = glyphs_.find(key);
+    if (it != glyphs_.end())
+        return it->second;
+
+    models_[model.get()] = model;
+
+    // Rasterize the shape at the quantized heading, with its origin at a whole pixel
+    geo::Transform2 rotation = fromXYA(0, 0, 2 * M_PI * i_heading / num_headings_);
+
+    std::vector<std::vector<cv::Point> > contours(model->contours.size());
+    cv::Point p_min(0, 0);
+    cv::Point p_max(0, 0);
+    for(unsigned int i = 0; i < model->contours.size(); ++i)
+    {
+        const std::vector<geo::Vec2>& points = model->contours[i].points;
+        contours[i].resize(points.size());
+        for(unsigned int j = 0; j < points.size(); ++j)
+        {
+            geo::Vec2 p = rotation * points[j];
+            cv::Point& p_img = contours[i][j];
+            p_img = cv::Point(cvRound(p.x * pixels_per_meter), cvRound(p.y * pixels_per_meter));
+
+            p_min.x = std::min(p_min.x, p_img.x);
+            p_min.y = std::min(p_min.y, p_img.y);
+            p_max.x = std::max(p_max.x, p_img.x);
+            p_max.y = std::max(p_max.y, p_img.y);
+        }
+    }
+
+    // Room for the line thickness and anti-aliasing
+    int border = thickness + 2;
+
+    Glyph& g = glyphs_[key];
+    g.origin = cv::Point(border - p_min.x, border - p_min.y);
+    g.mask = cv::Mat(p_max.y - p_min.y + 2 * border + 1, p_max.x - p_min.x + 2 * border + 1, CV_8UC1, cv::Scalar(0));
+
+    for(unsigned int i = 0; i < contours.size(); ++i)
+    {
+        for(unsigned int j = 0; j < contours[i].size(); ++j)
+            contours[i][j] += g.origin;
+    }
+
+    cv::polylines(g.mask, contours, true, cv::Scalar(255), thickness, CV_AA);
+
+    return g;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void GlyphCache::draw(Canvas& canvas, const Model2DConstPtr& model, const geo::Transform2& pose, const Color& color)
+{
+    const Glyph& g = glyph(model, canvas.pixels_per_meter, color.thickness, getRotation(pose));
+
+    cv::Point offset = canvas.worldToImage(pose.t) - g.origin;
+    canvas.modify(cv::Rect(offset.x, offset.y, g.mask.cols, g.mask.rows));
+
+    if (canvas.palette)
+        stampIndex(canvas.image, canvas.palette->index(color.color), g.mask, offset);
+    else
+        compositeColor(canvas.image, color.color, g.mask, offset);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void GlyphCache::draw(Canvas& canvas, const Model2DConstPtr& model, const std::vector<geo::Transform2>& poses, const Color& color)
+{
+    for(unsigned int i = 0; i < poses.size(); ++i)
+        draw(canvas, model, poses[i], color);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+GlyphCache& defaultGlyphCache()
+{
+    static GlyphCache cache;
+    return cache;
+}
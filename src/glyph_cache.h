@@ -0,0 +1,72 @@
+#ifndef _GLYPH_CACHE_H_
+#define _GLYPH_CACHE_H_
+
+#include "world_model.h"
+
+#include <map>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Draws small shapes (particles, sensor poses) by stamping pre-rasterized anti-aliased masks instead of
+// drawing their lines. Masks are made per shape, scale, line thickness and heading (quantized to
+// num_headings steps) on first use; the color is applied while stamping. Positions are rounded to
+// whole pixels, headings to the nearest step, so use this for markers, not for exact geometry.
+
+class GlyphCache
+{
+
+public:
+
+    GlyphCache(int num_headings = 64);
+
+    void draw(Canvas& canvas, const Model2DConstPtr& model, const geo::Transform2& pose, const Color& color);
+
+    void draw(Canvas& canvas, const Model2DConstPtr& model, const std::vector<geo::Transform2>& poses, const Color& color);
+
+    void clear() { glyphs_.clear(); models_.clear(); }
+
+    int numGlyphs() const { return glyphs_.size(); }
+
+private:
+
+    struct Glyph
+    {
+        cv::Mat mask;
+
+        // Position of the shape origin in the mask
+        cv::Point origin;
+    };
+
+    struct GlyphKey
+    {
+        const Model2D* model;
+        double pixels_per_meter;
+        int thickness;
+        int i_heading;
+
+        bool operator<(const GlyphKey& k) const
+        {
+            if (model != k.model) return model < k.model;
+            if (pixels_per_meter != k.pixels_per_meter) return pixels_per_meter < k.pixels_per_meter;
+            if (thickness != k.thickness) return thickness < k.thickness;
+            return i_heading < k.i_heading;
+        }
+    };
+
+    int num_headings_;
+
+    std::map<GlyphKey, Glyph> glyphs_;
+
+    // Keeps the shapes of which glyphs were made alive, so their addresses stay unique
+    std::map<const Model2D*, Model2DConstPtr> models_;
+
+    const Glyph& glyph(const Model2DConstPtr& model, double pixels_per_meter, int thickness, double heading);
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Glyph cache for the draw helpers of the sections (not thread-safe)
+GlyphCache& defaultGlyphCache();
+
+#endif
@@ -0,0 +1,100 @@
+#include "image_cache.h"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <sys/stat.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+ImageCache::ImageCache(std::size_t max_bytes) : max_bytes_(max_bytes), bytes_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+cv::Mat ImageCache::get(const std::string& filename, int width)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return cv::Mat();
+
+    Key key;
+    key.filename = filename;
+    key.width = std::max(width, 0);
+    key.mtime = st.st_mtime;
+
+    std::map<Key, Entry>::iterator it = entries_.find(key);
+    if (it != entries_.end())
+    {
+        lru_.splice(lru_.begin(), lru_, it->second.it_lru);
+        return it->second.image;
+    }
+
+    cv::Mat image = cv::imread(filename);
+    if (image.empty())
+        return image;
+
+    if (key.width > 0)
+    {
+        double f = (double)key.width / image.cols;
+        int height = f * image.rows;
+
+        cv::Mat image_resized;
+        cv::resize(image, image_resized, cv::Size(key.width, height));
+        image = image_resized;
+    }
+
+    std::size_t size = image.total() * image.elemSize();
+    if (size > max_bytes_)
+        return image;
+
+    lru_.push_front(key);
+
+    Entry& e = entries_[key];
+    e.image = image;
+    e.it_lru = lru_.begin();
+    bytes_ += size;
+
+    evict();
+
+    return image;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ImageCache::setMaxBytes(std::size_t max_bytes)
+{
+    max_bytes_ = max_bytes;
+    evict();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ImageCache::clear()
+{
+    entries_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ImageCache::evict()
+{
+    while(bytes_ > max_bytes_ && !lru_.empty())
+    {
+        std::map<Key, Entry>::iterator it = entries_.find(lru_.back());
+        bytes_ -= it->second.image.total() * it->second.image.elemSize();
+        entries_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+ImageCache& defaultImageCache()
+{
+    static ImageCache cache;
+    return cache;
+}
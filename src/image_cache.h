@@ -0,0 +1,73 @@
+#ifndef _IMAGE_CACHE_H_
+#define _IMAGE_CACHE_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Decoded and resized images, keyed by file name, width and modification time, so that a file is only
+// decoded again if it changed. The least recently used images are dropped when the total size exceeds
+// the byte budget. The returned images share their data with the cache: do not draw into them.
+
+class ImageCache
+{
+
+public:
+
+    ImageCache(std::size_t max_bytes = 64 << 20);
+
+    // Resized to 'width' pixels, keeping the aspect ratio (original size if width <= 0). Returns an
+    // empty image if the file can not be read.
+    cv::Mat get(const std::string& filename, int width = 0);
+
+    void setMaxBytes(std::size_t max_bytes);
+
+    std::size_t bytes() const { return bytes_; }
+
+    void clear();
+
+private:
+
+    struct Key
+    {
+        std::string filename;
+        int width;
+        time_t mtime;
+
+        bool operator<(const Key& k) const
+        {
+            if (filename != k.filename) return filename < k.filename;
+            if (width != k.width) return width < k.width;
+            return mtime < k.mtime;
+        }
+    };
+
+    struct Entry
+    {
+        cv::Mat image;
+        std::list<Key>::iterator it_lru;
+    };
+
+    std::size_t max_bytes_;
+    std::size_t bytes_;
+
+    std::map<Key, Entry> entries_;
+
+    // Most recently used first
+    std::list<Key> lru_;
+
+    void evict();
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Image cache for the draw helpers of the sections (not thread-safe)
+ImageCache& defaultImageCache();
+
+#endif
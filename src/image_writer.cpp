@@ -1,4 +1,6 @@
 #include "image_writer.h"
+#include "image_cache.h"
+#include "png_writer.h"
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -25,7 +27,7 @@ void CallBackFunc(int event, int x, int y, int flags, void* userdata)
 // ----------------------------------------------------------------------------------------------------
 
 ImageWriter::ImageWriter(int width, int height, const geo::Vec2& p1, const geo::Vec2& p2, const cv::Scalar& background_color)
-    : canvas_(width, height, background_color), do_show_(true), do_write_(false)
+    : canvas_(width, height, background_color), palette_mode_(false), do_show_(true), do_write_(false)
 {
     canvas_.pixels_per_meter = width / (p2.x - p1.x);
 }
@@ -38,10 +40,31 @@ ImageWriter::~ImageWriter()
 
 // ----------------------------------------------------------------------------------------------------
 
+void ImageWriter::setPaletteMode(bool b)
+{
+    palette_mode_ = b;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+boost::shared_ptr<Palette> ImageWriter::newPalette() const
+{
+    boost::shared_ptr<Palette> palette;
+    if (palette_mode_)
+        palette.reset(new Palette);
+    return palette;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 Canvas ImageWriter::nextCanvas()
 {
-    canvas_.clear();
-    return canvas_;
+    // Every canvas gets its own pixels and palette, so earlier canvases can still be used (or be written in
+    // another thread)
+    Canvas canvas(canvas_.width(), canvas_.height(), canvas_.background_color, newPalette());
+    canvas.pixels_per_meter = canvas_.pixels_per_meter;
+    canvas.center = canvas_.center;
+    return canvas;
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -53,7 +76,10 @@ void ImageWriter::process(const Canvas& canvas)
         MouseUserData data;
         data.canvas = &canvas;
 
-        cv::imshow("image", canvas.image);
+        cv::Mat bgr;
+        canvas.toBGR(bgr);
+
+        cv::imshow("image", bgr);
         cv::setMouseCallback("image", CallBackFunc, &data);
         char key = cv::waitKey();
         if (key == 'q')
@@ -62,47 +88,142 @@ void ImageWriter::process(const Canvas& canvas)
 
     if (do_write_)
     {
-        if (path_.empty())
-        {
-            std::cout << "Write path not set!" << std::endl;
+        std::string filename;
+        if (!nextFilename(filename))
             return;
-        }
 
-        if (label_.empty())
+        if (canvas.palette)
+            writePng(filename, canvas.image, &canvas.palette->colors());
+        else
+            cv::imwrite(filename, canvas.image);
+
+        ++image_num_;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ImageWriter::processTiled(const DisplayList& list, int width, int height, const geo::Vec2& p1, const geo::Vec2& p2,
+                               int strip_height)
+{
+    if (!do_write_)
+        return;
+
+    std::string filename;
+    if (!nextFilename(filename))
+        return;
+
+    // Only used for the bounding boxes of the commands (in poster coordinates) and for palette indices
+    Canvas view(1, 1, canvas_.background_color, newPalette());
+    view.pixels_per_meter = width / (p2.x - p1.x);
+    view.center = cv::Point(cvRound(-p1.x * view.pixels_per_meter), cvRound(-p1.y * view.pixels_per_meter));
+
+    int num_strips = (height + strip_height - 1) / strip_height;
+    std::vector<std::vector<int> > strips(num_strips);
+
+    // Rows a strip is drawn over: its own rows and those of its commands, so the commands are not clipped at
+    // the strip border (which moves pixels of lines)
+    std::vector<int> scratch_y_min(num_strips);
+    std::vector<int> scratch_y_max(num_strips);
+    for(int j = 0; j < num_strips; ++j)
+    {
+        scratch_y_min[j] = j * strip_height;
+        scratch_y_max[j] = std::min(height, (j + 1) * strip_height);
+    }
+
+    for(unsigned int i = 0; i < list.size(); ++i)
+    {
+        cv::Rect bb = list.boundingBox(i, view) & cv::Rect(0, 0, width, height);
+        if (bb.area() == 0)
+            continue;
+
+        for(int j = bb.y / strip_height; j <= (bb.y + bb.height - 1) / strip_height; ++j)
         {
-            std::cout << "Label not set!" << std::endl;
-            return;
+            strips[j].push_back(i);
+            scratch_y_min[j] = std::min(scratch_y_min[j], bb.y);
+            scratch_y_max[j] = std::max(scratch_y_max[j], bb.y + bb.height);
         }
 
+        // The palette is written before the first row, so it has to be complete before drawing
+        if (list.command(i).type != DisplayList::IMAGE)
+            view.ink(list.command(i).color.color);
+    }
+
+    PngWriter writer;
+    if (!writer.open(filename, width, height, view.palette ? &view.palette->colors() : 0))
+        return;
 
-        std::stringstream s_filename;
-//        s_filename << path_ << "/" << label_ << "-" << std::setfill('0') << std::setw(4) << image_num_ << ".png";
-        s_filename << path_ << "/" << label_ << "-" << image_num_ << ".png";
+    for(int j = 0; j < num_strips; ++j)
+    {
+        int y = j * strip_height;
+        int num_rows = std::min(strip_height, height - y);
 
-        std::cout << s_filename.str() << std::endl;
+        // At most one strip height more on both sides, to bound the memory use
+        int y_min = std::max(scratch_y_min[j], y - strip_height);
+        int y_max = std::min(scratch_y_max[j], y + num_rows + strip_height);
 
-        cv::imwrite(s_filename.str(), canvas.image);
+        Canvas scratch(width, y_max - y_min, canvas_.background_color, view.palette);
+        scratch.pixels_per_meter = view.pixels_per_meter;
+        scratch.center = view.center;
 
+        list.draw(scratch, strips[j], cv::Point(0, y_min));
+
+        if (!writer.write(scratch.image.rowRange(y - y_min, y - y_min + num_rows)))
+            return;
+    }
+
+    if (writer.close())
         ++image_num_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ImageWriter::nextFilename(std::string& filename) const
+{
+    if (path_.empty())
+    {
+        std::cout << "Write path not set!" << std::endl;
+        return false;
+    }
+
+    if (label_.empty())
+    {
+        std::cout << "Label not set!" << std::endl;
+        return false;
     }
+
+    std::stringstream s_filename;
+//    s_filename << path_ << "/" << label_ << "-" << std::setfill('0') << std::setw(4) << image_num_ << ".png";
+    s_filename << path_ << "/" << label_ << "-" << image_num_ << ".png";
+
+    filename = s_filename.str();
+    std::cout << filename << std::endl;
+
+    return true;
 }
 
 // ----------------------------------------------------------------------------------------------------
 
 void drawImage(Canvas& canvas, const std::string& filename, double width)
 {
-    cv::Mat image = cv::imread(filename);
-
     int width_pixels = canvas.width() * width;
-    double f = (double)width_pixels / image.cols;
-    int height_pixels = f * image.rows;
 
-    cv::Mat image_resized;
-    cv::resize(image, image_resized, cv::Size(width_pixels, height_pixels));
+    cv::Mat image_resized = defaultImageCache().get(filename, width_pixels);
+    if (image_resized.empty())
+    {
+        std::cout << "Could not load image: " << filename << std::endl;
+        return;
+    }
+
+    int height_pixels = image_resized.rows;
+
+    cv::Rect roi_rect((canvas.image.cols - width_pixels) / 2, (canvas.image.rows - height_pixels) / 2, width_pixels, height_pixels);
+    canvas.modify(roi_rect);
 
-    cv::Mat roi = canvas.image(cv::Rect((canvas.image.cols - width_pixels) / 2,
-                                        (canvas.image.rows - height_pixels) / 2,
-                                        width_pixels, height_pixels));
+    cv::Mat roi = canvas.image(roi_rect);
 
-    image_resized.copyTo(roi);
+    if (canvas.palette)
+        canvas.palette->quantize(image_resized, roi);
+    else
+        image_resized.copyTo(roi);
 }
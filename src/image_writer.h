@@ -1,7 +1,7 @@
 #ifndef _IMAGE_WRITER_H_
 #define _IMAGE_WRITER_H_
 
-#include "canvas.h"
+#include "display_list.h"
 
 class ImageWriter
 {
@@ -22,6 +22,11 @@ public:
 
     void setWrite(bool b = true) { do_write_ = b; }
 
+    // Canvases of the next calls to nextCanvas() draw palette indices (see Canvas), and are written as
+    // palette PNGs. Every canvas (and every processTiled() image) gets its own palette, so a PNG only holds
+    // the colors drawn into it, and canvases can be drawn in parallel.
+    void setPaletteMode(bool b = true);
+
     void setLabel(const std::string& label)
     {
         label_ = label;
@@ -32,10 +37,23 @@ public:
 
     void process(const Canvas& canvas);
 
+    // For images too large to keep in memory (e.g. posters): draws 'list' in strips of 'strip_height' rows
+    // and writes every strip to the PNG before drawing the next one, so memory use depends on the width and
+    // the strip height only. The world area from p1 (top-left) to p2 is scaled to 'width' pixels. Only
+    // writes, never shows.
+    //
+    // Each strip is drawn over the rows of its commands as well, up to one strip height above and below,
+    // which gives the same pixels as drawing the image at once. Lines that extend further are clipped at
+    // that border, where their pixels can be off by one.
+    void processTiled(const DisplayList& list, int width, int height, const geo::Vec2& p1, const geo::Vec2& p2,
+                      int strip_height = 256);
+
 private:
 
     Canvas canvas_;
 
+    bool palette_mode_;
+
     int image_num_;
 
     std::string label_;
@@ -47,6 +65,11 @@ private:
 
     std::string image_path_;
 
+    bool nextFilename(std::string& filename) const;
+
+    // Empty if not in palette mode
+    boost::shared_ptr<Palette> newPalette() const;
+
 };
 
 void drawImage(Canvas& canvas, const std::string& filename, double width);
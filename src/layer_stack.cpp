@@ -0,0 +1,73 @@
+#include "layer_stack.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+LayerStack::LayerStack() : i_dirty_(0), pixels_per_meter_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int LayerStack::addLayer()
+{
+    layers_.push_back(Layer());
+    i_dirty_ = std::min<unsigned int>(i_dirty_, layers_.size() - 1);
+    return layers_.size() - 1;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+DisplayList& LayerStack::edit(int i)
+{
+    i_dirty_ = std::min<unsigned int>(i_dirty_, i);
+    return layers_[i].list;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void LayerStack::setVisible(int i, bool visible)
+{
+    if (layers_[i].visible == visible)
+        return;
+
+    layers_[i].visible = visible;
+    i_dirty_ = std::min<unsigned int>(i_dirty_, i);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void LayerStack::draw(Canvas& canvas)
+{
+    if (background_.rows != canvas.image.rows || background_.cols != canvas.image.cols || background_color_ != canvas.background_color
+            || pixels_per_meter_ != canvas.pixels_per_meter || center_ != canvas.center || palette_ != canvas.palette)
+    {
+        background_ = cv::Mat(canvas.image.rows, canvas.image.cols, canvas.image.type(), canvas.ink(canvas.background_color));
+        background_color_ = canvas.background_color;
+        palette_ = canvas.palette;
+        pixels_per_meter_ = canvas.pixels_per_meter;
+        center_ = canvas.center;
+        i_dirty_ = 0;
+    }
+
+    for(unsigned int i = i_dirty_; i < layers_.size(); ++i)
+    {
+        Layer& layer = layers_[i];
+        const cv::Mat& below = (i == 0) ? background_ : layers_[i - 1].cache;
+        below.copyTo(layer.cache);
+
+        if (!layer.visible)
+            continue;
+
+        Canvas layer_canvas(canvas);
+        layer_canvas.image = layer.cache;
+        layer_canvas.buffer.reset(new CanvasBuffer(layer.cache));
+        renderer_.draw(layer_canvas, layer.list);
+    }
+
+    i_dirty_ = layers_.size();
+
+    canvas.modify();
+
+    const cv::Mat& top = layers_.empty() ? background_ : layers_.back().cache;
+    top.copyTo(canvas.image);
+}
@@ -0,0 +1,65 @@
+#ifndef _LAYER_STACK_H_
+#define _LAYER_STACK_H_
+
+#include "tiled_renderer.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+// Frame content as a stack of display lists (e.g. background, world, particles), drawn bottom to top onto
+// the background color. For every layer the stack keeps the image of that layer and everything below it,
+// so when only the top layers changed, drawing starts from the cached image below the lowest changed
+// layer. Layers are cached together with what is below them because anti-aliased drawing blends with it.
+
+class LayerStack
+{
+
+public:
+
+    LayerStack();
+
+    int addLayer();
+
+    unsigned int size() const { return layers_.size(); }
+
+    const DisplayList& layer(int i) const { return layers_[i].list; }
+
+    // Marks the layer as changed. Do not keep the reference: changes made through it after the next draw()
+    // are not noticed.
+    DisplayList& edit(int i);
+
+    void setVisible(int i, bool visible);
+
+    // Replaces the canvas image. Everything is drawn again if the canvas size, scale, center, background
+    // or palette differs from the previous call.
+    void draw(Canvas& canvas);
+
+private:
+
+    struct Layer
+    {
+        Layer() : visible(true) {}
+
+        DisplayList list;
+        bool visible;
+
+        // This layer and all layers below it
+        cv::Mat cache;
+    };
+
+    std::vector<Layer> layers_;
+
+    // Lowest layer of which the cache is out of date
+    unsigned int i_dirty_;
+
+    cv::Mat background_;
+    cv::Scalar background_color_;
+    boost::shared_ptr<Palette> palette_;
+
+    double pixels_per_meter_;
+    cv::Point center_;
+
+    TiledRenderer renderer_;
+
+};
+
+#endif
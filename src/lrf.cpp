@@ -1,22 +1,98 @@
 #include "lrf.h"
+#include "glyph_cache.h"
 #include "world_model.h"
 
 #include <opencv2/imgproc/imgproc.hpp>
 
 // ----------------------------------------------------------------------------------------------------
 
+namespace
+{
+
+// A filled circle exactly as cv::circle draws it, as horizontal spans, to be stamped many times
+class PointSprite
+{
+
+public:
+
+    PointSprite(int radius)
+    {
+        int c = radius + 1;
+        cv::Mat mask(2 * c + 1, 2 * c + 1, CV_8UC1, cv::Scalar(0));
+        cv::circle(mask, cv::Point(c, c), radius, cv::Scalar(255), CV_FILLED);
+
+        for(int y = 0; y < mask.rows; ++y)
+        {
+            const unsigned char* row = mask.ptr<unsigned char>(y);
+            for(int x = 0; x < mask.cols; ++x)
+            {
+                if (!row[x])
+                    continue;
+
+                Span s;
+                s.dy = y - c;
+                s.x1 = x - c;
+                while(x < mask.cols && row[x])
+                    ++x;
+                s.x2 = x - c;
+                spans_.push_back(s);
+            }
+        }
+    }
+
+    // 'color' has one byte per image channel
+    void draw(cv::Mat& image, int x, int y, const unsigned char* color) const
+    {
+        int cn = image.channels();
+        for(std::vector<Span>::const_iterator it = spans_.begin(); it != spans_.end(); ++it)
+        {
+            int yy = y + it->dy;
+            if (yy < 0 || yy >= image.rows)
+                continue;
+
+            int x1 = std::max(x + it->x1, 0);
+            int x2 = std::min(x + it->x2, image.cols);
+
+            unsigned char* p = image.ptr<unsigned char>(yy) + x1 * cn;
+            for(int xx = x1; xx < x2; ++xx)
+            {
+                for(int k = 0; k < cn; ++k)
+                    *p++ = color[k];
+            }
+        }
+    }
+
+private:
+
+    struct Span
+    {
+        int dy;
+        int x1;
+        int x2;     // exclusive
+    };
+
+    std::vector<Span> spans_;
+
+};
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 std::vector<double> renderLRF(const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const WorldModel2D& wm)
 {
+    wm.updatePoses();
+
     geo::Transform2 lrf_pose_inv = lrf_pose.inverse();
 
     std::vector<double> ranges(lrf.getNumBeams(), 0);
 
-    for(unsigned int i = 0; i < wm.entities.size(); ++i)
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
     {
-        const Entity2D& e = wm.entities[i];
-        geo::Transform2 t = lrf_pose_inv * e.pose;
+        const Entity2D& e = wm.entities()[i];
+        geo::Transform2 t = lrf_pose_inv * e.pose();
 
-        for(std::vector<Contour2D>::const_iterator it = e.shape.contours.begin(); it != e.shape.contours.end(); ++it)
+        for(std::vector<Contour2D>::const_iterator it = e.shape->contours.begin(); it != e.shape->contours.end(); ++it)
         {
             const Contour2D& c = *it;
 
@@ -34,20 +110,61 @@ std::vector<double> renderLRF(const geo::LaserRangeFinder& lrf, const geo::Trans
 
 // ----------------------------------------------------------------------------------------------------
 
+void projectRanges(const Canvas& canvas, const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
+                   ScanProjection& projection)
+{
+    unsigned int n = ranges.size();
+    projection.x.resize(n);
+    projection.y.resize(n);
+    projection.valid.resize(n);
+    projection.origin = canvas.worldToImage(lrf_pose.t);
+
+    std::vector<double> dx(n);
+    std::vector<double> dy(n);
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+        dx[i] = ray_dir.x;
+        dy[i] = ray_dir.y;
+    }
+
+    geo::Vec2 r0 = lrf_pose.R * geo::Vec2(1, 0);
+    geo::Vec2 r1 = lrf_pose.R * geo::Vec2(0, 1);
+    double tx = lrf_pose.t.x;
+    double ty = lrf_pose.t.y;
+    double f = canvas.pixels_per_meter;
+    double cx = canvas.center.x;
+    double cy = canvas.center.y;
+
+    // Straight loop over the arrays (vectorizable), with the same operations in the same order as
+    // lrf_pose * geo::Vec2(...) followed by canvas.worldToImage()
+    int* x = &projection.x[0];
+    int* y = &projection.y[0];
+    unsigned char* valid = &projection.valid[0];
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        double r = ranges[i];
+        double px = r * dx[i];
+        double py = r * dy[i];
+        x[i] = (r0.x * px + r1.x * py + tx) * f + cx;
+        y[i] = (r0.y * px + r1.y * py + ty) * f + cy;
+        valid[i] = r > 0;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 void rangesToImagePoints(Canvas& canvas, geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
                          std::vector<cv::Point>& points_image)
 {
-    points_image.resize(ranges.size());
+    ScanProjection projection;
+    projectRanges(canvas, lrf, lrf_pose, ranges, projection);
 
+    points_image.resize(ranges.size());
     for(unsigned int i = 0; i < ranges.size(); ++i)
     {
-        double r = ranges[i];
-        if (r <= 0)
-            continue;
-
-        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
-        geo::Vec2 p = lrf_pose * geo::Vec2(r * ray_dir.x, r * ray_dir.y);
-        points_image[i] = canvas.worldToImage(p);
+        if (projection.valid[i])
+            points_image[i] = cv::Point(projection.x[i], projection.y[i]);
     }
 }
 
@@ -56,23 +173,49 @@ void rangesToImagePoints(Canvas& canvas, geo::LaserRangeFinder& lrf, const geo::
 void drawRanges(Canvas& canvas, const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
                 const Color& point_color, const Color& line_color)
 {
-    cv::Point p_lrf = canvas.worldToImage(lrf_pose.t);
+    if (ranges.empty())
+        return;
+
+    ScanProjection projection;
+    projectRanges(canvas, lrf, lrf_pose, ranges, projection);
+
+    const cv::Point& p_lrf = projection.origin;
 
+    cv::Point p_min = p_lrf;
+    cv::Point p_max = p_lrf;
     for(unsigned int i = 0; i < ranges.size(); ++i)
     {
-        double r = ranges[i];
-        if (r <= 0)
+        if (!projection.valid[i])
             continue;
 
-        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+        p_min.x = std::min(p_min.x, projection.x[i]);
+        p_min.y = std::min(p_min.y, projection.y[i]);
+        p_max.x = std::max(p_max.x, projection.x[i]);
+        p_max.y = std::max(p_max.y, projection.y[i]);
+    }
+
+    int margin = std::max(point_color.thickness, line_color.valid ? line_color.thickness : 0) + 1;
+    canvas.modify(p_min, p_max, margin);
 
-        geo::Vec2 p = lrf_pose * geo::Vec2(r * ray_dir.x, r * ray_dir.y);
+    PointSprite sprite(point_color.thickness);
 
-        cv::Point p_cv = canvas.worldToImage(p);
-        cv::circle(canvas.image, p_cv, point_color.thickness, point_color.color, CV_FILLED);
+    cv::Scalar point_ink = canvas.ink(point_color.color);
+    cv::Scalar line_ink = line_color.valid ? canvas.ink(line_color.color) : cv::Scalar();
+
+    unsigned char color[4];
+    for(int k = 0; k < 4; ++k)
+        color[k] = cv::saturate_cast<unsigned char>(point_ink[k]);
+
+    // Per beam the point first, then its ray, like drawing them one by one
+    for(unsigned int i = 0; i < ranges.size(); ++i)
+    {
+        if (!projection.valid[i])
+            continue;
+
+        sprite.draw(canvas.image, projection.x[i], projection.y[i], color);
 
         if (line_color.valid)
-            cv::line(canvas.image, p_lrf, p_cv, line_color.color, line_color.thickness);
+            cv::line(canvas.image, p_lrf, cv::Point(projection.x[i], projection.y[i]), line_ink, line_color.thickness);
     }
 }
 
@@ -80,13 +223,7 @@ void drawRanges(Canvas& canvas, const geo::LaserRangeFinder& lrf, const geo::Tra
 
 void drawLRFPose(Canvas& canvas, const geo::Transform2& pose, const Color& color)
 {
-    Model2D model = createCircle(0.1);
-    Contour2D& c = model.addContour();
-
-    c.addPoint(0, 0);
-    c.addPoint(0.2, 0);
-
-    drawModel(canvas, model, pose, color);
+    defaultGlyphCache().draw(canvas, getPoseMarker(), pose, color);
 }
 
 // ----------------------------------------------------------------------------------------------------
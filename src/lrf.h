@@ -13,6 +13,23 @@ std::vector<double> renderLRF(const geo::LaserRangeFinder& lrf, const geo::Trans
 
 // ----------------------------------------------------------------------------------------------------
 
+// Beam end points of a scan in image coordinates, as separate arrays
+struct ScanProjection
+{
+    std::vector<int> x;
+    std::vector<int> y;
+
+    // 0 for beams without a range
+    std::vector<unsigned char> valid;
+
+    // Sensor position
+    cv::Point origin;
+};
+
+// Projects all beams at once; gives the same points as transforming and projecting them one by one
+void projectRanges(const Canvas& canvas, const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
+                   ScanProjection& projection);
+
 void rangesToImagePoints(Canvas& canvas, geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
                          std::vector<cv::Point>& points_image);
 
@@ -0,0 +1,153 @@
+#include "map_import.h"
+
+#include "occupancy_mapping.h"
+#include "scan_matcher.h"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+std::string trim(const std::string& s)
+{
+    std::size_t i1 = s.find_first_not_of(" \t\r\"'");
+    if (i1 == std::string::npos)
+        return "";
+
+    std::size_t i2 = s.find_last_not_of(" \t\r\"'");
+    return s.substr(i1, i2 - i1 + 1);
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool readMapMetaData(const std::string& filename, MapMetaData& meta)
+{
+    std::ifstream f(filename.c_str());
+    if (!f.is_open())
+    {
+        std::cout << "Could not open map file '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while(std::getline(f, line))
+    {
+        std::size_t i_comment = line.find('#');
+        if (i_comment != std::string::npos)
+            line = line.substr(0, i_comment);
+
+        std::size_t i_colon = line.find(':');
+        if (i_colon == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, i_colon));
+        std::string value = trim(line.substr(i_colon + 1));
+
+        if (key == "image")
+            meta.image = value;
+        else if (key == "resolution")
+            meta.resolution = atof(value.c_str());
+        else if (key == "negate")
+            meta.negate = (value == "1" || value == "true" || value == "True");
+        else if (key == "occupied_thresh")
+            meta.occupied_thresh = atof(value.c_str());
+        else if (key == "free_thresh")
+            meta.free_thresh = atof(value.c_str());
+        else if (key == "origin")
+        {
+            // [x, y, yaw]
+            for(unsigned int i = 0; i < value.size(); ++i)
+            {
+                if (value[i] == '[' || value[i] == ']' || value[i] == ',')
+                    value[i] = ' ';
+            }
+
+            std::stringstream s(value);
+            s >> meta.origin.x >> meta.origin.y >> meta.origin_yaw;
+        }
+    }
+
+    if (meta.image.empty())
+    {
+        std::cout << "Map file '" << filename << "' has no image" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool loadMap(const std::string& yaml_filename, WorldModel2D& wm, const MapImportParameters& params, SegmentGrid* grid)
+{
+    MapMetaData meta;
+    if (!readMapMetaData(yaml_filename, meta))
+        return false;
+
+    std::string image_filename = meta.image;
+    if (image_filename[0] != '/')
+    {
+        std::size_t i_slash = yaml_filename.rfind('/');
+        if (i_slash != std::string::npos)
+            image_filename = yaml_filename.substr(0, i_slash + 1) + image_filename;
+    }
+
+    cv::Mat image = cv::imread(image_filename, CV_LOAD_IMAGE_GRAYSCALE);
+    if (!image.data)
+    {
+        std::cout << "Could not load map image '" << image_filename << "'" << std::endl;
+        return false;
+    }
+
+    occupancyImageToWorldModel(image, meta, wm, params, grid);
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void occupancyImageToWorldModel(const cv::Mat& image, const MapMetaData& meta, WorldModel2D& wm,
+                                const MapImportParameters& params, SegmentGrid* grid)
+{
+    // Same interpretation as map_server: occupancy probability is (255 - value) / 255 (or value / 255 if
+    // negated). A lookup table keeps this a single pass over the image.
+    cv::Mat lut(1, 256, CV_8UC1);
+    for(int v = 0; v < 256; ++v)
+    {
+        double p = meta.negate ? v / 255.0 : (255 - v) / 255.0;
+        lut.at<unsigned char>(v) = p > meta.occupied_thresh ? 255 : 0;
+    }
+
+    cv::Mat mask;
+    cv::LUT(image, lut, mask);
+
+    // Image rows go down, world y goes up
+    cv::flip(mask, mask, 0);
+
+    // Trace in map coordinates, then put the entities at the map origin
+    WorldModel2D wm_map;
+    occupancyMaskToWorldModel(mask, geo::Vec2(0, 0), meta.resolution, params.simplify_tolerance, wm_map, params.color);
+
+    geo::Transform2 map_pose = fromXYA(meta.origin.x, meta.origin.y, meta.origin_yaw);
+    for(unsigned int i = 0; i < wm_map.entities().size(); ++i)
+        wm_map.setPose(i, map_pose);
+
+    if (grid)
+    {
+        grid->addWorldModel(wm_map);
+        grid->build();
+    }
+
+    wm.reserve(wm.entities().size() + wm_map.entities().size());
+    for(unsigned int i = 0; i < wm_map.entities().size(); ++i)
+        wm.addEntity(wm_map.entities()[i]);
+}
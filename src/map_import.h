@@ -0,0 +1,56 @@
+#ifndef _MAP_IMPORT_H_
+#define _MAP_IMPORT_H_
+
+#include "world_model.h"
+
+class SegmentGrid;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Contents of a ROS map_server YAML file
+struct MapMetaData
+{
+    MapMetaData() : resolution(0.05), origin(0, 0), origin_yaw(0), negate(false), occupied_thresh(0.65), free_thresh(0.196) {}
+
+    // Image path, relative to the YAML file unless absolute
+    std::string image;
+
+    double resolution;
+
+    // Pose of the lower-left corner of the map
+    geo::Vec2 origin;
+    double origin_yaw;
+
+    bool negate;
+    double occupied_thresh;
+    double free_thresh;
+};
+
+// Reads the flat 'key: value' subset of YAML that map_server uses. Returns false if the file can not be
+// read or has no image.
+bool readMapMetaData(const std::string& filename, MapMetaData& meta);
+
+// ----------------------------------------------------------------------------------------------------
+
+struct MapImportParameters
+{
+    MapImportParameters() : simplify_tolerance(0.025), color(0, 0, 0, 2) {}
+
+    // Contour vertices that are less than this (m) off the traced outline are removed. Values below the
+    // map resolution are fine and only remove the staircase of diagonal walls.
+    double simplify_tolerance;
+
+    Color color;
+};
+
+// Adds one entity per connected obstacle area of the map (outer contours clockwise, holes
+// counter-clockwise, like createBox). If 'grid' is given, the new contours are added to it and it is
+// built, ready for findNearest.
+bool loadMap(const std::string& yaml_filename, WorldModel2D& wm, const MapImportParameters& params = MapImportParameters(),
+             SegmentGrid* grid = 0);
+
+// Same, for an image that is already loaded (CV_8UC1, row 0 at the top, like the PGM)
+void occupancyImageToWorldModel(const cv::Mat& image, const MapMetaData& meta, WorldModel2D& wm,
+                                const MapImportParameters& params = MapImportParameters(), SegmentGrid* grid = 0);
+
+#endif
@@ -0,0 +1,316 @@
+#include "occupancy_mapping.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+// Beams are traced in chunks, each into its own list of updates
+const int BEAMS_PER_JOB = 64;
+
+// Beams of which the updates are buffered before they are applied
+const int BEAMS_PER_BATCH = 256 * BEAMS_PER_JOB;
+
+struct TraceJob
+{
+    int i_scan;
+    int i_first_beam;
+    int i_last_beam;
+};
+
+class TraceBeams : public cv::ParallelLoopBody
+{
+
+public:
+
+    TraceBeams(const EvidenceGrid& grid, const geo::LaserRangeFinder& lrf, const std::vector<geo::Transform2>& lrf_poses,
+               const std::vector<std::vector<double> >& scans, const std::vector<TraceJob>& jobs,
+               const OccupancyMappingParameters& params, std::vector<std::vector<EvidenceGrid::CellUpdate> >& job_updates)
+        : grid_(grid), lrf_(lrf), lrf_poses_(lrf_poses), scans_(scans), jobs_(jobs), params_(params), job_updates_(job_updates) {}
+
+    void operator()(const cv::Range& r) const
+    {
+        for(int j = r.start; j < r.end; ++j)
+        {
+            const TraceJob& job = jobs_[j];
+            const geo::Transform2& lrf_pose = lrf_poses_[job.i_scan];
+            const std::vector<double>& ranges = scans_[job.i_scan];
+
+            std::vector<EvidenceGrid::CellUpdate>& updates = job_updates_[j];
+
+            for(int i = job.i_first_beam; i <= job.i_last_beam; ++i)
+            {
+                double r = ranges[i];
+                if (r <= 0)
+                    continue;
+
+                const geo::Vec3& ray_dir = lrf_.getRayDirection(i);
+                geo::Vec2 p = lrf_pose * geo::Vec2(r * ray_dir.x, r * ray_dir.y);
+                grid_.traceRay(lrf_pose.t, p, params_.log_odds_free, params_.log_odds_hit, updates);
+            }
+        }
+    }
+
+private:
+
+    const EvidenceGrid& grid_;
+    const geo::LaserRangeFinder& lrf_;
+    const std::vector<geo::Transform2>& lrf_poses_;
+    const std::vector<std::vector<double> >& scans_;
+    const std::vector<TraceJob>& jobs_;
+    const OccupancyMappingParameters& params_;
+    std::vector<std::vector<EvidenceGrid::CellUpdate> >& job_updates_;
+};
+
+// Makes outer contours clockwise and holes counter-clockwise
+void addContour(const std::vector<cv::Point>& contour_image, const geo::Vec2& origin, double resolution,
+                double epsilon, bool is_hole, Model2D& model)
+{
+    std::vector<cv::Point> simplified;
+    cv::approxPolyDP(contour_image, simplified, epsilon, true);
+
+    if (simplified.size() < 2)
+        return;
+
+    Contour2D& c = model.addContour();
+    c.points.resize(simplified.size());
+    for(unsigned int i = 0; i < simplified.size(); ++i)
+    {
+        c.points[i] = geo::Vec2(origin.x + (simplified[i].x + 0.5) * resolution,
+                                origin.y + (simplified[i].y + 0.5) * resolution);
+    }
+
+    double area = c.signedArea();
+    if ((is_hole && area < 0) || (!is_hole && area > 0))
+        std::reverse(c.points.begin(), c.points.end());
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+OccupancyMapper::OccupancyMapper(double resolution, const OccupancyMappingParameters& params)
+    : grid_(resolution), params_(params)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void OccupancyMapper::integrateScan(const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges)
+{
+    for(unsigned int i = 0; i < ranges.size(); ++i)
+    {
+        double r = ranges[i];
+        if (r <= 0)
+            continue;
+
+        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+        geo::Vec2 p = lrf_pose * geo::Vec2(r * ray_dir.x, r * ray_dir.y);
+        grid_.updateRay(lrf_pose.t, p, params_.log_odds_free, params_.log_odds_hit);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void OccupancyMapper::integrateScans(const geo::LaserRangeFinder& lrf, const std::vector<geo::Transform2>& lrf_poses,
+                                     const std::vector<std::vector<double> >& scans)
+{
+    unsigned int num_scans = std::min(scans.size(), lrf_poses.size());
+
+    // Scans are done in batches, so only the updates of one batch are buffered at a time
+    unsigned int i_scan = 0;
+    while(i_scan < num_scans)
+    {
+        std::vector<TraceJob> jobs;
+        int num_beams_batch = 0;
+        for(; i_scan < num_scans && num_beams_batch < BEAMS_PER_BATCH; ++i_scan)
+        {
+            int num_beams = scans[i_scan].size();
+            for(int j = 0; j < num_beams; j += BEAMS_PER_JOB)
+            {
+                TraceJob job;
+                job.i_scan = i_scan;
+                job.i_first_beam = j;
+                job.i_last_beam = std::min(num_beams, j + BEAMS_PER_JOB) - 1;
+                jobs.push_back(job);
+            }
+
+            num_beams_batch += num_beams;
+        }
+
+        std::vector<std::vector<EvidenceGrid::CellUpdate> > job_updates(jobs.size());
+        cv::parallel_for_(cv::Range(0, jobs.size()), TraceBeams(grid_, lrf, lrf_poses, scans, jobs, params_, job_updates));
+
+        // Concatenate in scan and beam order, so the result equals integrating the scans one by one
+        unsigned int num_updates = 0;
+        for(unsigned int i = 0; i < job_updates.size(); ++i)
+            num_updates += job_updates[i].size();
+
+        std::vector<EvidenceGrid::CellUpdate> updates;
+        updates.reserve(num_updates);
+        for(unsigned int i = 0; i < job_updates.size(); ++i)
+        {
+            updates.insert(updates.end(), job_updates[i].begin(), job_updates[i].end());
+            std::vector<EvidenceGrid::CellUpdate>().swap(job_updates[i]);
+        }
+
+        grid_.applyUpdates(updates);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void OccupancyMapper::toWorldModel(WorldModel2D& wm, double simplify_tolerance, const Color& color) const
+{
+    cv::Mat log_odds;
+    geo::Vec2 origin;
+    gridToImage(grid_, log_odds, origin);
+
+    if (log_odds.empty())
+        return;
+
+    cv::Mat mask(log_odds.rows, log_odds.cols, CV_8UC1);
+    for(int y = 0; y < log_odds.rows; ++y)
+    {
+        const float* lo = log_odds.ptr<float>(y);
+        unsigned char* m = mask.ptr<unsigned char>(y);
+        for(int x = 0; x < log_odds.cols; ++x)
+            m[x] = lo[x] > params_.occupied_threshold ? 255 : 0;
+    }
+
+    occupancyMaskToWorldModel(mask, origin, grid_.resolution(), simplify_tolerance, wm, color);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void gridToImage(const EvidenceGrid& grid, cv::Mat& log_odds, geo::Vec2& origin)
+{
+    const std::vector<EvidenceGrid::Tile*>& tiles = grid.tiles();
+    if (tiles.empty())
+    {
+        log_odds = cv::Mat();
+        return;
+    }
+
+    int tx_min = tiles[0]->tx;
+    int ty_min = tiles[0]->ty;
+    int tx_max = tx_min;
+    int ty_max = ty_min;
+
+    for(unsigned int i = 1; i < tiles.size(); ++i)
+    {
+        tx_min = std::min(tx_min, tiles[i]->tx);
+        ty_min = std::min(ty_min, tiles[i]->ty);
+        tx_max = std::max(tx_max, tiles[i]->tx);
+        ty_max = std::max(ty_max, tiles[i]->ty);
+    }
+
+    const int ts = EvidenceGrid::TILE_SIZE;
+
+    log_odds = cv::Mat((ty_max - ty_min + 1) * ts, (tx_max - tx_min + 1) * ts, CV_32FC1, cv::Scalar(0));
+    origin = geo::Vec2(tx_min * ts * grid.resolution(), ty_min * ts * grid.resolution());
+
+    for(unsigned int i = 0; i < tiles.size(); ++i)
+    {
+        const EvidenceGrid::Tile& t = *tiles[i];
+        int x0 = (t.tx - tx_min) * ts;
+        int y0 = (t.ty - ty_min) * ts;
+
+        for(int y = 0; y < ts; ++y)
+            std::copy(t.cells + y * ts, t.cells + (y + 1) * ts, log_odds.ptr<float>(y0 + y) + x0);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void occupancyMaskToWorldModel(const cv::Mat& mask, const geo::Vec2& origin, double resolution,
+                               double simplify_tolerance, WorldModel2D& wm, const Color& color)
+{
+    // findContours modifies its input
+    cv::Mat m = mask.clone();
+
+    std::vector<std::vector<cv::Point> > contours;
+    std::vector<cv::Vec4i> hierarchy;
+    cv::findContours(m, contours, hierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE);
+
+    double epsilon = simplify_tolerance / resolution;
+
+    for(unsigned int i = 0; i < contours.size(); ++i)
+    {
+        // Only start at outer contours; their holes are the children in the hierarchy
+        if (hierarchy[i][3] >= 0)
+            continue;
+
+        Model2D model;
+        addContour(contours[i], origin, resolution, epsilon, false, model);
+
+        for(int j = hierarchy[i][2]; j >= 0; j = hierarchy[j][0])
+            addContour(contours[j], origin, resolution, epsilon, true, model);
+
+        if (!model.contours.empty())
+            wm.addEntity(model, geo::Transform2::identity(), color);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void drawOccupancyGrid(Canvas& canvas, const EvidenceGrid& grid)
+{
+    cv::Mat log_odds;
+    geo::Vec2 origin;
+    gridToImage(grid, log_odds, origin);
+
+    if (log_odds.empty())
+        return;
+
+    // Gray value per cell (0 is used for unknown cells, so known cells are at least 1)
+    cv::Mat gray(log_odds.rows, log_odds.cols, CV_8UC1);
+    for(int y = 0; y < log_odds.rows; ++y)
+    {
+        const float* lo = log_odds.ptr<float>(y);
+        unsigned char* g = gray.ptr<unsigned char>(y);
+        for(int x = 0; x < log_odds.cols; ++x)
+        {
+            if (lo[x] == 0)
+                g[x] = 0;
+            else
+                g[x] = std::max(1, (int)(255 / (1 + exp(lo[x]))));
+        }
+    }
+
+    // Palette canvases get 16 gray levels
+    std::vector<unsigned char> gray_ink(256);
+    for(int g = 1; g < 256; ++g)
+        gray_ink[g] = canvas.palette ? canvas.palette->index(cv::Scalar::all(g / 17 * 17)) : g;
+
+    std::vector<int> cell_x(canvas.width());
+    for(int x = 0; x < canvas.width(); ++x)
+        cell_x[x] = floor(((x - canvas.center.x) / canvas.pixels_per_meter - origin.x) / grid.resolution());
+
+    canvas.modify();
+
+    for(int y = 0; y < canvas.height(); ++y)
+    {
+        int cy = floor(((y - canvas.center.y) / canvas.pixels_per_meter - origin.y) / grid.resolution());
+        if (cy < 0 || cy >= gray.rows)
+            continue;
+
+        const unsigned char* g = gray.ptr<unsigned char>(cy);
+        unsigned char* row = canvas.image.ptr<unsigned char>(y);
+        int cn = canvas.image.channels();
+
+        for(int x = 0; x < canvas.width(); ++x)
+        {
+            int cx = cell_x[x];
+            if (cx < 0 || cx >= gray.cols || g[cx] == 0)
+                continue;
+
+            for(int k = 0; k < cn; ++k)
+                row[x * cn + k] = gray_ink[g[cx]];
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef _OCCUPANCY_MAPPING_H_
+#define _OCCUPANCY_MAPPING_H_
+
+#include "evidence_grid.h"
+#include "world_model.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+struct OccupancyMappingParameters
+{
+    OccupancyMappingParameters() : log_odds_hit(0.85f), log_odds_free(-0.4f), occupied_threshold(0.5f) {}
+
+    float log_odds_hit;
+    float log_odds_free;
+
+    // Cells with a log-odds above this are occupied
+    float occupied_threshold;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Builds a tiled occupancy grid from scans at known poses (e.g. simulated with renderLRF)
+
+class OccupancyMapper
+{
+
+public:
+
+    OccupancyMapper(double resolution = 0.05, const OccupancyMappingParameters& params = OccupancyMappingParameters());
+
+    void integrateScan(const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges);
+
+    // Rays of all beams of a batch of scans are traced in parallel, after which the tiles are updated in
+    // parallel. Batches are about 16k beams, which bounds the buffered updates.
+    void integrateScans(const geo::LaserRangeFinder& lrf, const std::vector<geo::Transform2>& lrf_poses,
+                        const std::vector<std::vector<double> >& scans);
+
+    // Traces the outlines of the occupied areas into entities (one per connected area, with its holes)
+    void toWorldModel(WorldModel2D& wm, double simplify_tolerance = 0.05, const Color& color = Color(0, 0, 0, 2)) const;
+
+    const EvidenceGrid& grid() const { return grid_; }
+
+    const OccupancyMappingParameters& parameters() const { return params_; }
+
+private:
+
+    EvidenceGrid grid_;
+
+    OccupancyMappingParameters params_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Copies the log-odds of all tiles into a CV_32FC1 image that covers their bounding box; rows go along
+// +y. 'origin' is the world position of the corner of cell (0, 0).
+void gridToImage(const EvidenceGrid& grid, cv::Mat& log_odds, geo::Vec2& origin);
+
+// Traces the outlines of the non-zero cells of a CV_8UC1 mask and adds one entity per connected area,
+// with outer contours clockwise and holes counter-clockwise (like createBox). Rows of the mask go along
+// +y and 'origin' is the world position of the corner of cell (0, 0). Vertices that are less than
+// simplify_tolerance (m) off the outline are removed.
+void occupancyMaskToWorldModel(const cv::Mat& mask, const geo::Vec2& origin, double resolution,
+                               double simplify_tolerance, WorldModel2D& wm, const Color& color = Color(0, 0, 0, 2));
+
+// ----------------------------------------------------------------------------------------------------
+
+// Draws known cells in gray (dark is occupied); unknown cells are left untouched
+void drawOccupancyGrid(Canvas& canvas, const EvidenceGrid& grid);
+
+#endif
@@ -0,0 +1,176 @@
+#include "particle_density.h"
+
+#include "world_model.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+// ----------------------------------------------------------------------------------------------------
+
+ParticleHistogram::ParticleHistogram(const Canvas& canvas, int cell_size_, int num_angle_bins_)
+    : cell_size(std::max(1, cell_size_)), num_angle_bins(std::max(1, num_angle_bins_)),
+      pixels_per_meter(canvas.pixels_per_meter), center(canvas.center), max_total(0)
+{
+    cols = (canvas.width() + cell_size - 1) / cell_size;
+    rows = (canvas.height() + cell_size - 1) / cell_size;
+
+    counts.resize(cols * rows * num_angle_bins, 0);
+    totals.resize(cols * rows, 0);
+    heading_x.resize(cols * rows, 0);
+    heading_y.resize(cols * rows, 0);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ParticleHistogram::addParticle(const geo::Transform2& p, double weight)
+{
+    // Same mapping as Canvas::worldToImage
+    int px = p.t.x * pixels_per_meter + center.x;
+    int py = p.t.y * pixels_per_meter + center.y;
+
+    if (px < 0 || py < 0)
+        return;
+
+    int x = px / cell_size;
+    int y = py / cell_size;
+
+    if (x >= cols || y >= rows)
+        return;
+
+    geo::Vec2 dir = p.R * geo::Vec2(1, 0);
+
+    int angle_bin = 0;
+    if (num_angle_bins > 1)
+    {
+        double a = atan2(dir.y, dir.x) + M_PI;
+        angle_bin = std::min(num_angle_bins - 1, (int)(a / (2 * M_PI) * num_angle_bins));
+    }
+
+    int i = y * cols + x;
+    counts[i * num_angle_bins + angle_bin] += weight;
+    totals[i] += weight;
+    heading_x[i] += weight * dir.x;
+    heading_y[i] += weight * dir.y;
+
+    max_total = std::max(max_total, totals[i]);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ParticleHistogram::addParticles(const std::vector<geo::Transform2>& particles)
+{
+    for(unsigned int i = 0; i < particles.size(); ++i)
+        addParticle(particles[i]);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ParticleHistogram::meanHeading(int x, int y, double& angle, double& concentration) const
+{
+    int i = y * cols + x;
+    if (totals[i] <= 0)
+        return false;
+
+    double hx = heading_x[i];
+    double hy = heading_y[i];
+
+    angle = atan2(hy, hx);
+    concentration = sqrt(hx * hx + hy * hy) / totals[i];
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void drawParticleDensity(Canvas& canvas, const ParticleHistogram& hist, const Color& color, bool draw_headings)
+{
+    if (hist.max_total <= 0)
+        return;
+
+    // 8-bit opacity lookup per cell, log-scaled so sparse areas stay visible next to dense ones
+    std::vector<int> alpha(hist.cols * hist.rows, 0);
+    double log_max = log(1 + hist.max_total);
+    for(unsigned int i = 0; i < alpha.size(); ++i)
+    {
+        if (hist.totals[i] > 0)
+            alpha[i] = 64 + (int)(191 * log(1 + hist.totals[i]) / log_max);
+    }
+
+    int cb = color.color[0];
+    int cg = color.color[1];
+    int cr = color.color[2];
+
+    // The density covers the whole canvas, and the headings lie within it
+    canvas.modify();
+
+    if (canvas.palette)
+    {
+        // Blends palette colors instead of pixels, at 8 opacity levels to keep the number of colors down
+        std::vector<int> blended(256 * 8, -1);
+        for(int y = 0; y < canvas.height(); ++y)
+        {
+            const int* alpha_row = &alpha[(y / hist.cell_size) * hist.cols];
+            unsigned char* row = canvas.image.ptr<unsigned char>(y);
+
+            for(int x = 0; x < canvas.width(); ++x)
+            {
+                int a = alpha_row[x / hist.cell_size];
+                if (a == 0)
+                    continue;
+
+                int& i = blended[row[x] * 8 + (a >> 5)];
+                if (i < 0)
+                    i = canvas.palette->blend(row[x], color.color, (a >> 5) * 32 + 16);
+                row[x] = i;
+            }
+        }
+    }
+    else
+    {
+        for(int y = 0; y < canvas.height(); ++y)
+        {
+            const int* alpha_row = &alpha[(y / hist.cell_size) * hist.cols];
+            cv::Vec3b* row = canvas.image.ptr<cv::Vec3b>(y);
+
+            for(int x = 0; x < canvas.width(); ++x)
+            {
+                int a = alpha_row[x / hist.cell_size];
+                if (a == 0)
+                    continue;
+
+                cv::Vec3b& c = row[x];
+                c[0] = (a * cb + (255 - a) * c[0]) / 255;
+                c[1] = (a * cg + (255 - a) * c[1]) / 255;
+                c[2] = (a * cr + (255 - a) * c[2]) / 255;
+            }
+        }
+    }
+
+    if (!draw_headings)
+        return;
+
+    double length = 0.45 * hist.cell_size;
+    cv::Scalar heading_color(0.5 * color.color[0], 0.5 * color.color[1], 0.5 * color.color[2]);
+
+    for(int y = 0; y < hist.rows; ++y)
+    {
+        for(int x = 0; x < hist.cols; ++x)
+        {
+            double a, concentration;
+            if (!hist.meanHeading(x, y, a, concentration))
+                continue;
+
+            cv::Point p1((x + 0.5) * hist.cell_size, (y + 0.5) * hist.cell_size);
+            cv::Point p2 = p1 + cv::Point(cos(a) * length * concentration, sin(a) * length * concentration);
+            cv::line(canvas.image, p1, p2, canvas.ink(heading_color), 1, canvas.lineType());
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void drawParticleDensity(Canvas& canvas, const std::vector<geo::Transform2>& particles, const Color& color,
+                         int cell_size, bool draw_headings)
+{
+    ParticleHistogram hist(canvas, cell_size);
+    hist.addParticles(particles);
+    drawParticleDensity(canvas, hist, color, draw_headings);
+}
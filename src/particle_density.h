@@ -0,0 +1,51 @@
+#ifndef _PARTICLE_DENSITY_H_
+#define _PARTICLE_DENSITY_H_
+
+#include "canvas.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+// Histogram of particle poses over the pixels of a canvas. Each cell covers cell_size x cell_size pixels
+// and is optionally split into num_angle_bins orientation bins.
+
+struct ParticleHistogram
+{
+    ParticleHistogram(const Canvas& canvas, int cell_size_ = 4, int num_angle_bins_ = 1);
+
+    void addParticle(const geo::Transform2& p, double weight = 1);
+
+    void addParticles(const std::vector<geo::Transform2>& particles);
+
+    double count(int x, int y) const { return totals[y * cols + x]; }
+
+    double count(int x, int y, int angle_bin) const { return counts[(y * cols + x) * num_angle_bins + angle_bin]; }
+
+    // Returns false if the cell is empty
+    bool meanHeading(int x, int y, double& angle, double& concentration) const;
+
+    int cell_size;
+    int num_angle_bins;
+    int cols;
+    int rows;
+
+    double pixels_per_meter;
+    cv::Point center;
+
+    std::vector<double> counts;      // (cell, angle bin)
+    std::vector<double> totals;      // cell
+    std::vector<double> heading_x;   // cell, sum of heading unit vectors
+    std::vector<double> heading_y;
+
+    double max_total;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Blends 'color' over the canvas with an opacity that follows the (log-scaled) cell density. The cost
+// depends on the number of pixels covered, not on the number of particles.
+void drawParticleDensity(Canvas& canvas, const ParticleHistogram& hist, const Color& color, bool draw_headings = false);
+
+void drawParticleDensity(Canvas& canvas, const std::vector<geo::Transform2>& particles, const Color& color,
+                         int cell_size = 4, bool draw_headings = false);
+
+#endif
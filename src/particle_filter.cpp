@@ -1,5 +1,10 @@
 #include "particle_filter.h"
+#include "display_list.h"
+#include "glyph_cache.h"
+#include "layer_stack.h"
 #include "lrf.h"
+#include "tiled_renderer.h"
+#include "world_index.h"
 
 #include <opencv2/imgproc/imgproc.hpp>
 
@@ -35,41 +40,29 @@ void drawLine(Canvas& canvas, const geo::Vec2& p1, const geo::Vec2& p2, const Co
 {
     cv::Point p1_img = canvas.worldToImage(p1);
     cv::Point p2_img = canvas.worldToImage(p2);
-    cv::line(canvas.image, p1_img, p2_img, color.color, color.thickness, CV_AA);
+    canvas.modify(p1_img, p2_img, color.thickness + 1);
+    cv::line(canvas.image, p1_img, p2_img, canvas.ink(color.color), color.thickness, canvas.lineType());
 }
 
 // ----------------------------------------------------------------------------------------------------
 
-Model2D createParticle()
+Model2DConstPtr createParticle()
 {
-    Model2D model = createCircle(0.1);
-    Contour2D& c = model.addContour();
-
-    c.addPoint(0, 0);
-    c.addPoint(0.2, 0);
-
-    return model;
+    return getPoseMarker(0.1, 0.2);
 }
 
 // ----------------------------------------------------------------------------------------------------
 
 void drawParticle(Canvas& canvas, const geo::Transform2& particle, const Color& color)
 {
-    Model2D particle_model = createParticle();
-    drawModel(canvas, particle_model, particle, color);
+    defaultGlyphCache().draw(canvas, createParticle(), particle, color);
 }
 
 // ----------------------------------------------------------------------------------------------------
 
 void drawParticles(Canvas& canvas, const std::vector<geo::Transform2>& particles, const Color& color)
 {
-    Model2D particle_model = createParticle();
-
-    for(unsigned int i = 0; i < particles.size(); ++i)
-    {
-        const geo::Transform2& p = particles[i];
-        drawModel(canvas, particle_model, p, color);
-    }
+    defaultGlyphCache().draw(canvas, createParticle(), particles, color);
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -94,7 +87,7 @@ void drawGraph(Canvas& graph_canvas)
 // ----------------------------------------------------------------------------------------------------
 
 std::vector<geo::Transform2> filterParticles(const geo::LaserRangeFinder& lrf, const std::vector<geo::Transform2>& particles,
-                     const std::vector<double>& ranges_real, const WorldModel2D& wm)
+                     const std::vector<double>& ranges_real, const WorldModel2D& wm, const WorldIndex* index = 0)
 {
     std::vector<geo::Transform2> new_particles;
 
@@ -104,6 +97,14 @@ std::vector<geo::Transform2> filterParticles(const geo::LaserRangeFinder& lrf, c
     for(unsigned int i = 0; i < particles.size(); ++i)
     {
         const geo::Transform2& p = particles[i];
+
+        // Poses inside obstacles can never be right, do not bother scoring them
+        if (index && !index->isFree(p.t))
+        {
+            particle_probs[i] = 0;
+            continue;
+        }
+
         std::vector<double> ranges_hyp = renderLRF(lrf, p, wm);
 
         for(unsigned j = 0; j < ranges_hyp.size(); ++j)
@@ -128,22 +129,19 @@ std::vector<geo::Transform2> filterParticles(const geo::LaserRangeFinder& lrf, c
 void drawParticleFilter(Canvas& canvas, const geo::LaserRangeFinder& lrf, const std::vector<geo::Transform2>& particles,
                         const geo::Transform2& real_pos, const WorldModel2D& wm, int i_particle = -1)
 {
-    Model2D particle_model = createParticle();
+    Model2DConstPtr particle_model = createParticle();
 
     Color color1(255, 100, 100, 1);
     Color color2(255, 0, 0, 2);
 
-    for(unsigned int i = 0; i < particles.size(); ++i)
-    {
-        const geo::Transform2& p = particles[i];
-        drawModel(canvas, particle_model, p, color1);
-    }
+    GlyphCache& glyphs = defaultGlyphCache();
+    glyphs.draw(canvas, particle_model, particles, color1);
 
     if (i_particle >= 0)
     {
         const geo::Transform2& p = particles[i_particle];
 
-        drawModel(canvas, particle_model, p, color2);
+        glyphs.draw(canvas, particle_model, p, color2);
 
         Canvas sub_canvas = canvas.createSubCanvas(0.1, 0.1, 0.3, 0.3);
         sub_canvas.center.y = 0.8 * sub_canvas.height();
@@ -155,6 +153,8 @@ void drawParticleFilter(Canvas& canvas, const geo::LaserRangeFinder& lrf, const
         geo::Transform2 sub_pose(geo::Mat2(0, 1, -1, 0), geo::Vec2(0, 0));
         cv::Point sub_pose_cv = sub_canvas.worldToImage(sub_pose.t);
 
+        sub_canvas.modify();
+
         for(unsigned int i = 0; i < ranges_particle.size(); ++i)
         {
             double rp = ranges_particle[i];
@@ -167,19 +167,19 @@ void drawParticleFilter(Canvas& canvas, const geo::LaserRangeFinder& lrf, const
                 cv::Point pp_cv = sub_canvas.worldToImage(sub_pose * geo::Vec2(rp * ray_dir.x, rp * ray_dir.y));
                 cv::Point pm_cv = sub_canvas.worldToImage(sub_pose * geo::Vec2(rm * ray_dir.x, rm * ray_dir.y));
 
-                cv::line(sub_canvas.image, sub_pose_cv, pp_cv, cv::Scalar(230, 230, 230));
-                cv::line(sub_canvas.image, sub_pose_cv, pm_cv, cv::Scalar(230, 230, 230));
-                cv::line(sub_canvas.image, pp_cv, pm_cv, cv::Scalar(100, 100, 100), 1);
+                cv::line(sub_canvas.image, sub_pose_cv, pp_cv, sub_canvas.ink(cv::Scalar(230, 230, 230)));
+                cv::line(sub_canvas.image, sub_pose_cv, pm_cv, sub_canvas.ink(cv::Scalar(230, 230, 230)));
+                cv::line(sub_canvas.image, pp_cv, pm_cv, sub_canvas.ink(cv::Scalar(100, 100, 100)), 1);
 
-                cv::circle(sub_canvas.image, pp_cv, 3, cv::Scalar(0, 0, 255), CV_FILLED);
-                cv::circle(sub_canvas.image, pm_cv, 3, cv::Scalar(0, 150, 0), CV_FILLED);
+                cv::circle(sub_canvas.image, pp_cv, 3, sub_canvas.ink(cv::Scalar(0, 0, 255)), CV_FILLED);
+                cv::circle(sub_canvas.image, pm_cv, 3, sub_canvas.ink(cv::Scalar(0, 150, 0)), CV_FILLED);
             }
         }
 
-        drawModel(sub_canvas, particle_model, sub_pose, color2);
+        glyphs.draw(sub_canvas, particle_model, sub_pose, color2);
     }
 
-    drawModel(canvas, particle_model, real_pos, Color(0, 255, 0, 2));
+    glyphs.draw(canvas, particle_model, real_pos, Color(0, 255, 0, 2));
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -255,16 +255,21 @@ void particleFilterSection(ImageWriter& iw)
     Color particle_color(255, 100, 100, 1);
     Color particle_color_bold(255, 0, 0, 2);
 
+    WorldIndex index;
+    index.build(wm);
+
+    // Only hypotheses in free space, at least 10 cm from the walls
     std::vector<geo::Transform2> particles;
     for(double y = -1.5; y < 2; y += 0.5)
     {
         for(double x = -1.5; x < 2; x += 0.5)
         {
+            geo::Transform2 pose = room_offset * fromXYA(x, y, 0);
+            if (!index.isFree(pose.t, 0.1))
+                continue;
+
             for(double a = 0; a < 6; a += M_PI / 4)
-            {
-                if (x < 1 || y < 1)
-                    particles.push_back(room_offset * fromXYA(x, y, a));
-            }
+                particles.push_back(room_offset * fromXYA(x, y, a));
         }
     }
 
@@ -299,7 +304,7 @@ void particleFilterSection(ImageWriter& iw)
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
     const geo::Transform2& particle = particles[0];
-    cv::Mat img_particles = canvas.image.clone();
+    CanvasSnapshot img_particles = canvas.snapshot();
     drawParticle(canvas, particle, particle_color_bold);
     iw.process(canvas);
 
@@ -317,7 +322,7 @@ void particleFilterSection(ImageWriter& iw)
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     // Show graph
 
-    cv::Mat temp = canvas.image.clone();
+    CanvasSnapshot temp = canvas.snapshot();
 
     Canvas graph_canvas = canvas.createSubCanvas(0.525, 0.2, 0.35, 0.35);
     graph_canvas.center.y = 0.9 * graph_canvas.height();
@@ -328,12 +333,12 @@ void particleFilterSection(ImageWriter& iw)
 
     // TODO: show association process
 
-    canvas.image = temp.clone();
+    canvas.restore(temp);
     iw.process(canvas);
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-    canvas.image = img_particles.clone();
+    canvas.restore(img_particles);
     iw.process(canvas);
 
     int num_i_examples = 10;
@@ -343,7 +348,7 @@ void particleFilterSection(ImageWriter& iw)
     {
         int i = i_examples[k];
 
-        canvas.image = img_particles.clone();
+        canvas.restore(img_particles);
         Canvas test_canvas = canvas.createSubCanvas(0.1, 0.2, 0.35, 0.35);
         test_canvas.center.y = 0.9 * test_canvas.height();
         test_canvas.pixels_per_meter = canvas.pixels_per_meter / 1.5;
@@ -370,7 +375,7 @@ void particleFilterSection(ImageWriter& iw)
     for(int i = 0; i < particles.size(); ++i)
         drawParticle(canvas, particles[i], particle_color);
 
-    particles = filterParticles(lrf, particles, ranges_real, wm);
+    particles = filterParticles(lrf, particles, ranges_real, wm, &index);
 
     for(int i = 0; i < particles.size(); ++i)
         drawParticle(canvas, particles[i], particle_color_bold);
@@ -383,13 +388,19 @@ void particleFilterSection(ImageWriter& iw)
 
     geo::Transform2 odom = fromXYADegrees(0, 0, 45);
 
+    // The world does not change anymore
+    DisplayList world_list;
+    world_list.addWorld(wm);
+
+    TiledRenderer renderer;
+
     for(int i = 0; i < 3; ++i)
     {
         if (i > 0)
             real_pose = real_pose * odom;
 
         canvas = iw.nextCanvas();
-        drawWorld(canvas, wm);
+        renderer.draw(canvas, world_list);
 
         for(int j = 0; j < particles.size(); ++j)
             drawParticle(canvas, particles[j], particle_color);
@@ -414,7 +425,7 @@ void particleFilterSection(ImageWriter& iw)
     for(int i = 0; i < 3; ++i)
     {
         canvas = iw.nextCanvas();
-        drawWorld(canvas, wm);
+        renderer.draw(canvas, world_list);
 
         test_canvas = canvas.createSubCanvas(0.1, 0.2, 0.35, 0.35);
         test_canvas.center.y = 0.9 * test_canvas.height();
@@ -438,6 +449,19 @@ void particleFilterSection(ImageWriter& iw)
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+    // Only the overlays of the particle under consideration change per frame
+    LayerStack layers;
+    layers.edit(layers.addLayer()).append(world_list);
+
+    int particle_layer = layers.addLayer();
+    {
+        Model2DConstPtr particle_model = createParticle();
+        DisplayList& particle_list = layers.edit(particle_layer);
+        particle_list.addModel(*particle_model, real_pose, Color(0, 150, 0, 2));
+        for(int j = 0; j < particles.size(); ++j)
+            particle_list.addModel(*particle_model, particles[j], particle_color);
+    }
+
     for(int k = 0; k < particles.size() + 1; ++k)
     {
         int i = k;
@@ -447,14 +471,8 @@ void particleFilterSection(ImageWriter& iw)
         }
 
         canvas = iw.nextCanvas();
-        drawWorld(canvas, wm);
-
-        if (k < particles.size())
-        {
-            drawParticle(canvas, real_pose, Color(0, 150, 0, 2));
-            for(int j = 0; j < particles.size(); ++j)
-                drawParticle(canvas, particles[j], particle_color);
-        }
+        layers.setVisible(particle_layer, k < particles.size());
+        layers.draw(canvas);
 
         Canvas test_canvas = canvas.createSubCanvas(0.1, 0.2, 0.35, 0.35);
         test_canvas.center.y = 0.9 * test_canvas.height();
@@ -0,0 +1,194 @@
+#include "png_writer.h"
+
+#include <png.h>
+
+#include <iostream>
+
+// libpng reports errors with a longjmp back to the setjmp of the calling function, so those functions
+// do not have locals with destructors.
+
+// ----------------------------------------------------------------------------------------------------
+
+PngWriter::PngWriter() : file_(0), png_(0), info_(0), width_(0), height_(0), num_rows_written_(0), indexed_(false)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+PngWriter::~PngWriter()
+{
+    release();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PngWriter::release()
+{
+    if (png_)
+        png_destroy_write_struct(&png_, &info_);
+
+    png_ = 0;
+    info_ = 0;
+
+    if (file_)
+        fclose(file_);
+
+    file_ = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool PngWriter::open(const std::string& filename, int width, int height, const std::vector<cv::Vec3b>* palette)
+{
+    release();
+
+    if (palette && (palette->empty() || palette->size() > 256))
+    {
+        std::cout << "PngWriter: palette must have 1 to 256 colors" << std::endl;
+        return false;
+    }
+
+    file_ = fopen(filename.c_str(), "wb");
+    if (!file_)
+    {
+        std::cout << "Could not open file: " << filename << std::endl;
+        return false;
+    }
+
+    png_ = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
+    if (png_)
+        info_ = png_create_info_struct(png_);
+
+    if (!info_)
+    {
+        std::cout << "PngWriter: could not initialize libpng" << std::endl;
+        release();
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png_)))
+    {
+        std::cout << "Could not write PNG: " << filename << std::endl;
+        release();
+        return false;
+    }
+
+    png_init_io(png_, file_);
+
+    width_ = width;
+    height_ = height;
+    num_rows_written_ = 0;
+    indexed_ = (palette != 0);
+
+    if (indexed_)
+    {
+        int num_colors = palette->size();
+        int bit_depth = num_colors <= 2 ? 1 : (num_colors <= 4 ? 2 : (num_colors <= 16 ? 4 : 8));
+
+        png_set_IHDR(png_, info_, width, height, bit_depth, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+        png_color colors[256];
+        for(int i = 0; i < num_colors; ++i)
+        {
+            const cv::Vec3b& c = (*palette)[i];
+            colors[i].red = c[2];
+            colors[i].green = c[1];
+            colors[i].blue = c[0];
+        }
+
+        png_set_PLTE(png_, info_, colors, num_colors);
+    }
+    else
+    {
+        png_set_IHDR(png_, info_, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    }
+
+    png_write_info(png_, info_);
+
+    // Rows come with one byte per index (packed by libpng), or in BGR order
+    if (indexed_)
+        png_set_packing(png_);
+    else
+        png_set_bgr(png_);
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool PngWriter::write(const cv::Mat& rows)
+{
+    if (!file_)
+    {
+        std::cout << "PngWriter: not open" << std::endl;
+        return false;
+    }
+
+    if (rows.cols != width_ || rows.type() != (indexed_ ? CV_8UC1 : CV_8UC3) || num_rows_written_ + rows.rows > height_)
+    {
+        std::cout << "PngWriter: rows do not fit the image" << std::endl;
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png_)))
+    {
+        std::cout << "PngWriter: could not write rows" << std::endl;
+        release();
+        return false;
+    }
+
+    // libpng copies the row before transforming it
+    for(int y = 0; y < rows.rows; ++y)
+        png_write_row(png_, const_cast<unsigned char*>(rows.ptr<unsigned char>(y)));
+
+    num_rows_written_ += rows.rows;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool PngWriter::close()
+{
+    if (!file_)
+        return false;
+
+    if (num_rows_written_ != height_)
+    {
+        std::cout << "PngWriter: " << num_rows_written_ << " of " << height_ << " rows written" << std::endl;
+        release();
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png_)))
+    {
+        std::cout << "PngWriter: could not finish the image" << std::endl;
+        release();
+        return false;
+    }
+
+    png_write_end(png_, 0);
+    png_destroy_write_struct(&png_, &info_);
+    png_ = 0;
+    info_ = 0;
+
+    int result = fclose(file_);
+    file_ = 0;
+
+    if (result != 0)
+    {
+        std::cout << "PngWriter: could not close the file" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool writePng(const std::string& filename, const cv::Mat& image, const std::vector<cv::Vec3b>* palette)
+{
+    PngWriter writer;
+    return writer.open(filename, image.cols, image.rows, palette) && writer.write(image) && writer.close();
+}
@@ -0,0 +1,57 @@
+#ifndef _PNG_WRITER_H_
+#define _PNG_WRITER_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <cstdio>
+
+struct png_struct_def;
+struct png_info_def;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Writes a PNG row by row, so the image never has to be in memory as a whole. Rows are CV_8UC3 (BGR), or
+// CV_8UC1 palette indices if the PNG is opened with a palette. Small palettes are written with fewer bits
+// per pixel.
+
+class PngWriter
+{
+
+public:
+
+    PngWriter();
+
+    ~PngWriter();
+
+    // 'palette' is BGR, at most 256 colors
+    bool open(const std::string& filename, int width, int height, const std::vector<cv::Vec3b>* palette = 0);
+
+    // Appends rows, top to bottom
+    bool write(const cv::Mat& rows);
+
+    // Fails if not all rows were written
+    bool close();
+
+    bool isOpen() const { return file_ != 0; }
+
+private:
+
+    FILE* file_;
+
+    png_struct_def* png_;
+    png_info_def* info_;
+
+    int width_;
+    int height_;
+    int num_rows_written_;
+    bool indexed_;
+
+    void release();
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+bool writePng(const std::string& filename, const cv::Mat& image, const std::vector<cv::Vec3b>* palette = 0);
+
+#endif
@@ -0,0 +1,495 @@
+#include "pose_graph.h"
+
+#include "world_model.h"
+
+#include <iostream>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+double normalizeAngle(double a)
+{
+    while (a > M_PI)
+        a -= 2 * M_PI;
+    while (a < -M_PI)
+        a += 2 * M_PI;
+    return a;
+}
+
+// Error of the measured relative pose z (zx, zy, za) between nodes i and j, and its jacobians A (w.r.t.
+// node i) and B (w.r.t. node j)
+void linearizeEdge(double xi, double yi, double ai, double xj, double yj, double aj, double zx, double zy, double za,
+                   Eigen::Vector3d& e, Eigen::Matrix3d& A, Eigen::Matrix3d& B)
+{
+    double ci = cos(ai);
+    double si = sin(ai);
+    double cz = cos(za);
+    double sz = sin(za);
+
+    double dx = xj - xi;
+    double dy = yj - yi;
+
+    // Position of j in the frame of i
+    double u =  ci * dx + si * dy;
+    double v = -si * dx + ci * dy;
+
+    e(0) =  cz * (u - zx) + sz * (v - zy);
+    e(1) = -sz * (u - zx) + cz * (v - zy);
+    e(2) = normalizeAngle(aj - ai - za);
+
+    Eigen::Matrix2d Rz_t;
+    Rz_t << cz, sz, -sz, cz;
+
+    Eigen::Matrix2d Ri_t;
+    Ri_t << ci, si, -si, ci;
+
+    A.setZero();
+    A.block<2, 2>(0, 0) = -Rz_t * Ri_t;
+    A.block<2, 1>(0, 2) = Rz_t * Eigen::Vector2d(v, -u);
+    A(2, 2) = -1;
+
+    B.setZero();
+    B.block<2, 2>(0, 0) = Rz_t * Ri_t;
+    B(2, 2) = 1;
+}
+
+int findRoot(std::vector<int>& parents, int i)
+{
+    while (parents[i] != i)
+    {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+PoseGraph::PoseGraph() : structure_changed_(true)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+PoseGraph::~PoseGraph()
+{
+    clearComponents();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int PoseGraph::addNode(const geo::Transform2& pose, bool fixed)
+{
+    x_.push_back(pose.t.x);
+    y_.push_back(pose.t.y);
+    a_.push_back(getRotation(pose));
+    fixed_.push_back(fixed);
+
+    structure_changed_ = true;
+    return x_.size() - 1;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int PoseGraph::addEdge(int i1, int i2, const geo::Transform2& measurement, double w_translation, double w_rotation)
+{
+    if (i1 < 0 || i2 < 0 || i1 >= numNodes() || i2 >= numNodes() || i1 == i2)
+    {
+        std::cout << "PoseGraph::addEdge: invalid nodes " << i1 << " and " << i2 << std::endl;
+        return -1;
+    }
+
+    PoseGraphEdge e;
+    e.i1 = i1;
+    e.i2 = i2;
+    e.measurement = measurement;
+    e.w_translation = w_translation;
+    e.w_rotation = w_rotation;
+    edges_.push_back(e);
+
+    structure_changed_ = true;
+    return edges_.size() - 1;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PoseGraph::setMeasurement(int i_edge, const geo::Transform2& measurement)
+{
+    edges_[i_edge].measurement = measurement;
+    markDirty(edges_[i_edge].i1);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PoseGraph::setPose(int i, const geo::Transform2& pose)
+{
+    x_[i] = pose.t.x;
+    y_[i] = pose.t.y;
+    a_[i] = getRotation(pose);
+    markDirty(i);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PoseGraph::setFixed(int i, bool fixed)
+{
+    if (fixed_[i] == fixed)
+        return;
+
+    fixed_[i] = fixed;
+
+    // Changes the set of optimized variables, and therefore the sparsity pattern
+    structure_changed_ = true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::Transform2 PoseGraph::pose(int i) const
+{
+    return fromXYA(x_[i], y_[i], a_[i]);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PoseGraph::markDirty(int i_node)
+{
+    if (structure_changed_)
+        return;
+
+    components_[node_component_[i_node]]->dirty = true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PoseGraph::clearComponents()
+{
+    for(unsigned int i = 0; i < components_.size(); ++i)
+        delete components_[i];
+    components_.clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PoseGraph::updateComponents()
+{
+    clearComponents();
+
+    int num_nodes = x_.size();
+
+    std::vector<int> parents(num_nodes);
+    for(int i = 0; i < num_nodes; ++i)
+        parents[i] = i;
+
+    for(unsigned int i = 0; i < edges_.size(); ++i)
+    {
+        int r1 = findRoot(parents, edges_[i].i1);
+        int r2 = findRoot(parents, edges_[i].i2);
+        if (r1 != r2)
+            parents[std::max(r1, r2)] = std::min(r1, r2);
+    }
+
+    node_component_.assign(num_nodes, -1);
+    node_block_.assign(num_nodes, -1);
+
+    std::vector<int> root_component(num_nodes, -1);
+    for(int i = 0; i < num_nodes; ++i)
+    {
+        int r = findRoot(parents, i);
+        if (root_component[r] < 0)
+        {
+            root_component[r] = components_.size();
+            components_.push_back(new Component);
+        }
+
+        node_component_[i] = root_component[r];
+        components_[node_component_[i]]->nodes.push_back(i);
+    }
+
+    for(unsigned int i = 0; i < edges_.size(); ++i)
+        components_[node_component_[edges_[i].i1]]->edges.push_back(i);
+
+    for(unsigned int k = 0; k < components_.size(); ++k)
+    {
+        Component& c = *components_[k];
+
+        bool has_fixed = false;
+        for(unsigned int j = 0; j < c.nodes.size(); ++j)
+            has_fixed = has_fixed || fixed_[c.nodes[j]];
+
+        // Without a fixed node, anchor the component at its first node (removes the gauge freedom)
+        for(unsigned int j = has_fixed ? 0 : 1; j < c.nodes.size(); ++j)
+        {
+            int i = c.nodes[j];
+            if (fixed_[i])
+                continue;
+
+            node_block_[i] = c.free_nodes.size();
+            c.free_nodes.push_back(i);
+        }
+    }
+
+    structure_changed_ = false;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double PoseGraph::computeError(const Component& c) const
+{
+    double error = 0;
+
+    Eigen::Vector3d e;
+    Eigen::Matrix3d A, B;
+
+    for(unsigned int k = 0; k < c.edges.size(); ++k)
+    {
+        const PoseGraphEdge& edge = edges_[c.edges[k]];
+        int i = edge.i1;
+        int j = edge.i2;
+
+        linearizeEdge(x_[i], y_[i], a_[i], x_[j], y_[j], a_[j], edge.measurement.t.x, edge.measurement.t.y,
+                      getRotation(edge.measurement), e, A, B);
+
+        error += edge.w_translation * (e(0) * e(0) + e(1) * e(1)) + edge.w_rotation * e(2) * e(2);
+    }
+
+    return error;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PoseGraph::optimizeComponent(Component& c, const PoseGraphParameters& params, PoseGraphResult& result)
+{
+    int n = 3 * c.free_nodes.size();
+    if (n == 0 || c.edges.empty())
+        return;
+
+    typedef Eigen::Triplet<double> Triplet;
+
+    std::vector<Triplet> triplets;
+    triplets.reserve(9 * (4 * c.edges.size() + c.free_nodes.size()));
+
+    Eigen::SparseMatrix<double> H(n, n);
+    Eigen::VectorXd b(n);
+
+    std::vector<double> x_backup(c.free_nodes.size());
+    std::vector<double> y_backup(c.free_nodes.size());
+    std::vector<double> a_backup(c.free_nodes.size());
+
+    double lambda = params.initial_lambda;
+    double error = computeError(c);
+
+    result.initial_error += error;
+
+    Eigen::Vector3d e;
+    Eigen::Matrix3d A, B;
+
+    int iteration = 0;
+    for(; iteration < params.max_iterations; ++iteration)
+    {
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Build the normal equations
+
+        triplets.clear();
+        b.setZero();
+
+        for(unsigned int k = 0; k < c.edges.size(); ++k)
+        {
+            const PoseGraphEdge& edge = edges_[c.edges[k]];
+            int i = edge.i1;
+            int j = edge.i2;
+
+            linearizeEdge(x_[i], y_[i], a_[i], x_[j], y_[j], a_[j], edge.measurement.t.x, edge.measurement.t.y,
+                          getRotation(edge.measurement), e, A, B);
+
+            Eigen::Vector3d w(edge.w_translation, edge.w_translation, edge.w_rotation);
+            Eigen::Matrix3d At_W = A.transpose() * w.asDiagonal();
+            Eigen::Matrix3d Bt_W = B.transpose() * w.asDiagonal();
+
+            int bi = node_block_[i];
+            int bj = node_block_[j];
+
+            Eigen::Matrix3d Hii = At_W * A;
+            Eigen::Matrix3d Hij = At_W * B;
+            Eigen::Matrix3d Hjj = Bt_W * B;
+
+            for(int r = 0; r < 3; ++r)
+            {
+                for(int s = 0; s < 3; ++s)
+                {
+                    if (bi >= 0)
+                        triplets.push_back(Triplet(3 * bi + r, 3 * bi + s, Hii(r, s)));
+                    if (bj >= 0)
+                        triplets.push_back(Triplet(3 * bj + r, 3 * bj + s, Hjj(r, s)));
+                    if (bi >= 0 && bj >= 0)
+                    {
+                        triplets.push_back(Triplet(3 * bi + r, 3 * bj + s, Hij(r, s)));
+                        triplets.push_back(Triplet(3 * bj + s, 3 * bi + r, Hij(r, s)));
+                    }
+                }
+            }
+
+            if (bi >= 0)
+                b.segment<3>(3 * bi) += At_W * e;
+            if (bj >= 0)
+                b.segment<3>(3 * bj) += Bt_W * e;
+        }
+
+        // Damping; always added so the sparsity pattern does not depend on lambda
+        for(int k = 0; k < n; ++k)
+            triplets.push_back(Triplet(k, k, lambda));
+
+        H.setFromTriplets(triplets.begin(), triplets.end());
+
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Solve
+
+        if (!c.pattern_analyzed)
+        {
+            c.solver.analyzePattern(H);
+            c.pattern_analyzed = true;
+        }
+
+        c.solver.factorize(H);
+        if (c.solver.info() != Eigen::Success)
+            break;
+
+        Eigen::VectorXd dx = c.solver.solve(-b);
+
+        for(unsigned int k = 0; k < c.free_nodes.size(); ++k)
+        {
+            int i = c.free_nodes[k];
+            x_backup[k] = x_[i];
+            y_backup[k] = y_[i];
+            a_backup[k] = a_[i];
+
+            x_[i] += dx(3 * k);
+            y_[i] += dx(3 * k + 1);
+            a_[i] = normalizeAngle(a_[i] + dx(3 * k + 2));
+        }
+
+        double new_error = computeError(c);
+
+        if (new_error < error)
+        {
+            bool converged = (error - new_error) < params.min_error_decrease;
+            error = new_error;
+            lambda *= 0.1;
+
+            if (converged)
+            {
+                ++iteration;
+                break;
+            }
+        }
+        else
+        {
+            // Reject the step
+            for(unsigned int k = 0; k < c.free_nodes.size(); ++k)
+            {
+                int i = c.free_nodes[k];
+                x_[i] = x_backup[k];
+                y_[i] = y_backup[k];
+                a_[i] = a_backup[k];
+            }
+
+            if (lambda <= 0)
+                break;
+
+            lambda *= 10;
+        }
+    }
+
+    result.final_error += error;
+    result.iterations = std::max(result.iterations, iteration);
+    ++result.num_components;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+PoseGraphResult PoseGraph::optimize(const PoseGraphParameters& params)
+{
+    if (structure_changed_)
+        updateComponents();
+
+    PoseGraphResult result;
+
+    for(unsigned int i = 0; i < components_.size(); ++i)
+    {
+        Component& c = *components_[i];
+        if (!c.dirty)
+            continue;
+
+        optimizeComponent(c, params, result);
+        c.dirty = false;
+    }
+
+    return result;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void buildPoseGraph(const WorldModel2D& wm, const std::vector<Link>& links, PoseGraph& graph)
+{
+    wm.updatePoses();
+
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
+        graph.addNode(wm.entities()[i].pose());
+
+    for(unsigned int i = 0; i < links.size(); ++i)
+    {
+        const Link& link = links[i];
+        if (link.i1 < 0 || link.i2 < 0 || link.i1 >= (int)wm.entities().size() || link.i2 >= (int)wm.entities().size())
+        {
+            std::cout << "buildPoseGraph: link " << i << " refers to an unknown entity" << std::endl;
+            continue;
+        }
+
+        geo::Transform2 measurement = link.measured ? link.measurement
+                                                    : wm.entities()[link.i1].pose().inverse() * wm.entities()[link.i2].pose();
+
+        graph.addEdge(link.i1, link.i2, measurement, link.w_translation, link.w_rotation);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void applyPoseGraph(const PoseGraph& graph, WorldModel2D& wm)
+{
+    if (graph.numNodes() != (int)wm.entities().size())
+    {
+        std::cout << "applyPoseGraph: graph has " << graph.numNodes() << " nodes, world model "
+                  << wm.entities().size() << " entities" << std::endl;
+        return;
+    }
+
+    // Entities without edges are left alone, so they stay where their parent puts them
+    std::vector<bool> linked(graph.numNodes(), false);
+    for(int i = 0; i < graph.numEdges(); ++i)
+    {
+        linked[graph.edge(i).i1] = true;
+        linked[graph.edge(i).i2] = true;
+    }
+
+    std::vector<int> stack;
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
+    {
+        if (wm.entities()[i].parent() < 0)
+            stack.push_back(i);
+    }
+
+    while(!stack.empty())
+    {
+        int i = stack.back();
+        stack.pop_back();
+
+        if (linked[i])
+            wm.setPose(i, graph.pose(i));
+
+        const std::vector<int>& children = wm.entities()[i].children();
+        stack.insert(stack.end(), children.begin(), children.end());
+    }
+}
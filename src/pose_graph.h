@@ -0,0 +1,171 @@
+#ifndef _POSE_GRAPH_H_
+#define _POSE_GRAPH_H_
+
+#include <geolib/datatypes.h>
+
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+// ----------------------------------------------------------------------------------------------------
+
+struct PoseGraphEdge
+{
+    int i1;
+    int i2;
+
+    // Pose of node i2 in the frame of node i1
+    geo::Transform2 measurement;
+
+    // Information (inverse variance) of the translation and rotation error
+    double w_translation;
+    double w_rotation;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Relation between two entities of a world model. A link with a measurement says where entity i2 was
+// seen in the frame of entity i1; a link without one keeps the relative pose the entities have now.
+struct Link
+{
+    Link(int i1_, int i2_) : i1(i1_), i2(i2_), measured(false), w_translation(1), w_rotation(1) {}
+
+    Link(int i1_, int i2_, const geo::Transform2& measurement_, double w_translation_ = 1, double w_rotation_ = 1)
+        : i1(i1_), i2(i2_), measured(true), measurement(measurement_), w_translation(w_translation_), w_rotation(w_rotation_) {}
+
+    int i1;
+    int i2;
+
+    bool measured;
+    geo::Transform2 measurement;
+
+    double w_translation;
+    double w_rotation;
+};
+
+struct WorldModel2D;
+
+// ----------------------------------------------------------------------------------------------------
+
+struct PoseGraphParameters
+{
+    PoseGraphParameters() : max_iterations(20), initial_lambda(1e-4), min_error_decrease(1e-9) {}
+
+    int max_iterations;
+
+    // Levenberg-Marquardt damping. 0 gives plain Gauss-Newton.
+    double initial_lambda;
+
+    double min_error_decrease;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+struct PoseGraphResult
+{
+    PoseGraphResult() : iterations(0), num_components(0), initial_error(0), final_error(0) {}
+
+    int iterations;
+    int num_components;     // number of connected components that were re-optimized
+    double initial_error;
+    double final_error;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// 2D pose graph. Nodes are poses, edges relative pose measurements between them. The graph is split in
+// connected components; optimize() only re-solves components in which something changed since the last
+// call, and re-uses the symbolic sparse Cholesky factorization of a component as long as its structure
+// (nodes and edges) stays the same. Components without a fixed node are anchored at their first node.
+
+class PoseGraph
+{
+
+public:
+
+    PoseGraph();
+
+    ~PoseGraph();
+
+    int addNode(const geo::Transform2& pose, bool fixed = false);
+
+    // Returns -1 (and adds nothing) if i1 or i2 is not a node, or if they are the same node
+    int addEdge(int i1, int i2, const geo::Transform2& measurement, double w_translation = 1, double w_rotation = 1);
+
+    void setMeasurement(int i_edge, const geo::Transform2& measurement);
+
+    void setPose(int i, const geo::Transform2& pose);
+
+    void setFixed(int i, bool fixed = true);
+
+    geo::Transform2 pose(int i) const;
+
+    bool isFixed(int i) const { return fixed_[i]; }
+
+    const PoseGraphEdge& edge(int i) const { return edges_[i]; }
+
+    int numNodes() const { return x_.size(); }
+
+    int numEdges() const { return edges_.size(); }
+
+    PoseGraphResult optimize(const PoseGraphParameters& params = PoseGraphParameters());
+
+private:
+
+    struct Component
+    {
+        Component() : dirty(true), pattern_analyzed(false) {}
+
+        std::vector<int> nodes;
+        std::vector<int> edges;
+
+        bool dirty;
+        bool pattern_analyzed;
+
+        // Nodes that are optimized, and their block index in the system
+        std::vector<int> free_nodes;
+
+        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > solver;
+    };
+
+    // Node poses as (x, y, angle)
+    std::vector<double> x_;
+    std::vector<double> y_;
+    std::vector<double> a_;
+    std::vector<bool> fixed_;
+
+    std::vector<PoseGraphEdge> edges_;
+
+    // Per node, component index and block index within that component (-1 if not optimized)
+    std::vector<int> node_component_;
+    std::vector<int> node_block_;
+
+    std::vector<Component*> components_;
+    bool structure_changed_;
+
+    void updateComponents();
+
+    void clearComponents();
+
+    double computeError(const Component& c) const;
+
+    void optimizeComponent(Component& c, const PoseGraphParameters& params, PoseGraphResult& result);
+
+    void markDirty(int i_node);
+
+    // Non-copyable (components own solvers)
+    PoseGraph(const PoseGraph&);
+    PoseGraph& operator=(const PoseGraph&);
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Node i is entity i of the world model, at its world pose; every link becomes an edge. Nodes are not
+// fixed: fix at least one node per connected part that should stay in place.
+void buildPoseGraph(const WorldModel2D& wm, const std::vector<Link>& links, PoseGraph& graph);
+
+// Moves the entities that have edges to the poses of their nodes with WorldModel2D::setPose, parents
+// before children. Entities without edges keep their pose relative to their parent.
+void applyPoseGraph(const PoseGraph& graph, WorldModel2D& wm);
+
+#endif
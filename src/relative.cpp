@@ -1,6 +1,7 @@
 #include "relative.h"
 
 #include "image_writer.h"
+#include "pose_graph.h"
 #include "world_model.h"
 
 #include <opencv2/imgproc/imgproc.hpp>
@@ -8,23 +9,16 @@
 
 // ----------------------------------------------------------------------------------------------------
 
-struct Link
-{
-    Link(int i1_, int i2_) : i1(i1_), i2(i2_) {}
-    int i1;
-    int i2;
-};
-
-// ----------------------------------------------------------------------------------------------------
-
 void drawAxis(Canvas& canvas, const geo::Transform2& t)
 {
     cv::Point p0 = canvas.worldToImage(t.t);
     cv::Point px = canvas.worldToImage((t * geo::Vec2(0.2, 0)));
     cv::Point py = canvas.worldToImage((t * geo::Vec2(0, -0.2)));
 
-    cv::line(canvas.image, p0, px, cv::Scalar(0, 0, 255), 2);
-    cv::line(canvas.image, p0, py, cv::Scalar(0, 150, 0), 2);
+    canvas.modify(p0, px, 3);
+    canvas.modify(p0, py, 3);
+    cv::line(canvas.image, p0, px, canvas.ink(cv::Scalar(0, 0, 255)), 2);
+    cv::line(canvas.image, p0, py, canvas.ink(cv::Scalar(0, 150, 0)), 2);
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -42,6 +36,11 @@ void drawArrow(Canvas& canvas, const geo::Vec2& p1, const geo::Vec2& p2, const C
     cv::Point phead1_img = canvas.worldToImage(phead1);
     cv::Point phead2_img = canvas.worldToImage(phead2);
 
+    int margin = color.thickness + 1;
+    canvas.modify(p1_img, p2_img, margin);
+    canvas.modify(p2_img, phead1_img, margin);
+    canvas.modify(p2_img, phead2_img, margin);
+
     if (dashed)
     {
         cv::Point2d diff = p2_img - p1_img;
@@ -61,16 +60,16 @@ void drawArrow(Canvas& canvas, const geo::Vec2& p1, const geo::Vec2& p2, const C
         {
             cv::Point2d p1a_img = cv::Point2d(p1_img.x, p1_img.y) + b * diff_n;
             cv::Point2d p2a_img = cv::Point2d(p1_img.x, p1_img.y) + (w + b) * diff_n;
-            cv::line(canvas.image, p1a_img, p2a_img, color.color, color.thickness, CV_AA);
+            cv::line(canvas.image, p1a_img, p2a_img, canvas.ink(color.color), color.thickness, canvas.lineType());
         }
     }
     else
     {
-        cv::line(canvas.image, p1_img, p2_img, color.color, color.thickness, CV_AA);
+        cv::line(canvas.image, p1_img, p2_img, canvas.ink(color.color), color.thickness, canvas.lineType());
     }
 
-    cv::line(canvas.image, p2_img, phead1_img, color.color, color.thickness, CV_AA);
-    cv::line(canvas.image, p2_img, phead2_img, color.color, color.thickness, CV_AA);
+    cv::line(canvas.image, p2_img, phead1_img, canvas.ink(color.color), color.thickness, canvas.lineType());
+    cv::line(canvas.image, p2_img, phead2_img, canvas.ink(color.color), color.thickness, canvas.lineType());
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -79,11 +78,11 @@ void drawWorldModelAbsolute(Canvas& canvas, const WorldModel2D& wm, const geo::V
 {
     drawWorld(canvas, wm);
 
-    for(unsigned int i = 1; i < wm.entities.size(); ++i)
+    for(unsigned int i = 1; i < wm.entities().size(); ++i)
     {
-        const Entity2D& e = wm.entities[i];
-        drawArrow(canvas, p0, e.pose.t, Color(150, 150, 150, 2));
-        drawAxis(canvas, e.pose);
+        const Entity2D& e = wm.entities()[i];
+        drawArrow(canvas, p0, e.pose().t, Color(150, 150, 150, 2));
+        drawAxis(canvas, e.pose());
     }
 
     drawAxis(canvas, fromXYA(p0.x, p0.y, 0));
@@ -99,13 +98,13 @@ void drawWorldModelSceneGraph(Canvas& canvas, const WorldModel2D& wm, const std:
     {
         const Link& link = links[i];
 
-        const Entity2D& e1 = wm.entities[link.i1];
-        const Entity2D& e2 = wm.entities[link.i2];
+        const Entity2D& e1 = wm.entities()[link.i1];
+        const Entity2D& e2 = wm.entities()[link.i2];
 
-        drawArrow(canvas, e1.pose.t, e2.pose.t, Color(150, 150, 150, 2));
+        drawArrow(canvas, e1.pose().t, e2.pose().t, Color(150, 150, 150, 2));
 
-        drawAxis(canvas, e1.pose);
-        drawAxis(canvas, e2.pose);
+        drawAxis(canvas, e1.pose());
+        drawAxis(canvas, e2.pose());
     }
 
 //    drawAxis(canvas, fromXYA(p0.x, p0.y, 0));
@@ -118,10 +117,12 @@ void drawRectangle(Canvas& canvas, const geo::Vec2& p1, const geo::Vec2& p2, con
     cv::Point p1_img = canvas.worldToImage(p1);
     cv::Point p2_img = canvas.worldToImage(p2);
 
+    canvas.modify(p1_img, p2_img, color.thickness + 1);
+
     if (filled)
-        cv::rectangle(canvas.image, p1_img, p2_img, color.color, CV_FILLED);
+        cv::rectangle(canvas.image, p1_img, p2_img, canvas.ink(color.color), CV_FILLED);
     else
-        cv::rectangle(canvas.image, p1_img, p2_img, color.color, color.thickness);
+        cv::rectangle(canvas.image, p1_img, p2_img, canvas.ink(color.color), color.thickness);
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -132,9 +133,13 @@ void drawTriangle(Canvas& canvas, const geo::Vec2& p1, const geo::Vec2& p2, cons
     cv::Point p2_img = canvas.worldToImage(p2);
     cv::Point p3_img = canvas.worldToImage(p3);
 
-    cv::line(canvas.image, p1_img, p2_img, color.color, color.thickness);
-    cv::line(canvas.image, p1_img, p3_img, color.color, color.thickness);
-    cv::line(canvas.image, p2_img, p3_img, color.color, color.thickness);
+    canvas.modify(p1_img, p2_img, color.thickness + 1);
+    canvas.modify(p1_img, p3_img, color.thickness + 1);
+    canvas.modify(p2_img, p3_img, color.thickness + 1);
+
+    cv::line(canvas.image, p1_img, p2_img, canvas.ink(color.color), color.thickness);
+    cv::line(canvas.image, p1_img, p3_img, canvas.ink(color.color), color.thickness);
+    cv::line(canvas.image, p2_img, p3_img, canvas.ink(color.color), color.thickness);
 }
 
 
@@ -152,13 +157,9 @@ Model2D createTarget()
 
 // ----------------------------------------------------------------------------------------------------
 
-Model2D createLRFPose()
+Model2DConstPtr createLRFPose()
 {
-    Model2D model = createCircle(0.1);
-    Contour2D& c = model.addContour();
-    c.addPoint(0, 0);
-    c.addPoint(0.2, 0);
-    return model;
+    return getPoseMarker(0.1, 0.2);
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -186,21 +187,27 @@ Model2D createSoccerFieldModel()
 
 // ----------------------------------------------------------------------------------------------------
 
-Model2D createTurtleModel()
+Model2DConstPtr createTurtleModel()
 {
+    // All turtles share the same shape
+    static Model2DConstPtr turtle;
+    if (turtle)
+        return turtle;
+
     double radius = 0.3;
     double bla = sqrt(2.0) / 2 * radius;
-    Model2D m = createCircle(radius);
+    Model2D* m = new Model2D(createCircle(radius));
 
-    Contour2D& c1 = m.addContour();
+    Contour2D& c1 = m->addContour();
     c1.addPoint(0, 0);
     c1.addPoint(bla, bla);
 
-    Contour2D& c2 = m.addContour();
+    Contour2D& c2 = m->addContour();
     c2.addPoint(0, 0);
     c2.addPoint(bla, -bla);
 
-    return m;
+    turtle.reset(m);
+    return turtle;
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -230,23 +237,23 @@ void relativeSection(ImageWriter& iw)
     wm.addEntity(createBox(geo::Vec2(0, -4.09), geo::Vec2(7.63, 0), true), fromXYADegrees(-3.75, 2.1, 0));
 
 
-    int idx_couch = wm.entities.size();
+    int idx_couch = wm.entities().size();
     wm.addEntity(createBox(0.691667, 1.45833), fromXYADegrees(-0.529166, 0.404165, 0));
     wm.addEntity(createBox(0.45833, 0.6), fromXYADegrees(-1.69583, 0.375, 0));
     wm.addEntity(createBox(0.95833, 0.516667), fromXYADegrees(-1.72917, -0.616667, 0));
     wm.addEntity(createBox(0.96666, 0.50833), fromXYADegrees(-1.75, 1.37084, 0));
     wm.addEntity(createBox(1.6, 0.30834), fromXYADegrees(-0.45, -1.8375, 0));
 
-    int idx_table = wm.entities.size();
+    int idx_table = wm.entities().size();
     wm.addEntity(createBox(0.65, 0.95), fromXYADegrees(1.6, 0.4, 0));
 
-    int idx_cabinet = wm.entities.size();
+    int idx_cabinet = wm.entities().size();
     wm.addEntity(createBox(0.55, 1.28333), fromXYADegrees(3.54167, 0.558333, 0));
 
     wm.addEntity(createCircle(0.1), fromXYA(0.358333, 1.81667, 0));
     wm.addEntity(createCircle(0.1), fromXYA(-1.73333, -1.78333, 0));
 
-    int idx_plant = wm.entities.size();
+    int idx_plant = wm.entities().size();
     wm.addEntity(createCircle(0.1), fromXYA(3.18333, 1.68333, 0));
 
     Model2D model;
@@ -273,12 +280,12 @@ void relativeSection(ImageWriter& iw)
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-    int idx_lrf = wm.entities.size();
+    int idx_lrf = wm.entities().size();
     wm.addEntity(createLRFPose(), fromXYADegrees(0.533333, -1.24167, 145), Color(0, 150, 0, 2));
     drawWorld(canvas, wm);
     iw.process(canvas);
 
-    int idx_target = wm.entities.size();
+    int idx_target = wm.entities().size();
     wm.addEntity(createTarget(), fromXYADegrees(-0.533333, -0.725, 0), Color(255, 0, 0, 2));
     drawWorld(canvas, wm);
     iw.process(canvas);
@@ -295,7 +302,7 @@ void relativeSection(ImageWriter& iw)
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 //    canvas = iw.nextCanvas();
-    drawWorldModelAbsolute(canvas, wm, wm.entities[0].pose.t);
+    drawWorldModelAbsolute(canvas, wm, wm.entities()[0].pose().t);
     iw.process(canvas);
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -332,9 +339,9 @@ void relativeSection(ImageWriter& iw)
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
     WorldModel2D wm2;
-    wm2.entities.push_back(wm.entities[idx_lrf]);
-    wm2.entities.push_back(wm.entities[idx_couch]);
-    wm2.entities.push_back(wm.entities[idx_target]);
+    wm2.addEntity(wm.entities()[idx_lrf]);
+    wm2.addEntity(wm.entities()[idx_couch]);
+    wm2.addEntity(wm.entities()[idx_target]);
 
     links.clear();
     links.push_back(Link(0, 1));
@@ -347,12 +354,20 @@ void relativeSection(ImageWriter& iw)
     canvas = iw.nextCanvas();
     drawImage(canvas, iw.image_path() + "/livingroom2.jpg", 0.9);
 
-    wm.entities[idx_target].pose.t.y += 0.7;
-    wm.entities[idx_couch].pose.t.y += 0.7;
+    // The LRF sees the couch 0.7 m further. The target is on the couch, so it keeps its pose relative to
+    // the couch and moves along.
+    geo::Transform2 couch_pose = wm.entities()[idx_couch].pose();
+    couch_pose.t.y += 0.7;
 
     links.clear();
     links.push_back(Link(idx_couch, idx_target));
-    links.push_back(Link(idx_lrf, idx_couch));
+    links.push_back(Link(idx_lrf, idx_couch, wm.entities()[idx_lrf].pose().inverse() * couch_pose));
+
+    PoseGraph graph;
+    buildPoseGraph(wm, links, graph);
+    graph.setFixed(idx_lrf);
+    graph.optimize();
+    applyPoseGraph(graph, wm);
 
     drawWorldModelSceneGraph(canvas, wm, links);
     iw.process(canvas);
@@ -377,7 +392,7 @@ void relativeSection(ImageWriter& iw)
 //Click: [ 2.075 0.025 ]
 //Click: [ 2 1.7125 ]  ball
 
-    wm.entities.clear();
+    wm.clear();
     wm.addEntity(createSoccerFieldModel(), geo::Transform2::identity(), Color(255, 255, 255, 2));
     wm.addEntity(createCircle(0.2), fromXYA(2, 1.7125, 0), Color(255, 220, 0, 2));
 
@@ -420,7 +435,7 @@ void relativeSection(ImageWriter& iw)
     drawWorldModelSceneGraph(canvas, wm, links);
     iw.process(canvas);
 
-    drawArrow(canvas, wm.entities[3].pose.t, wm.entities[1].pose.t, Color(150, 150, 150, 2), true);
+    drawArrow(canvas, wm.entities()[3].pose().t, wm.entities()[1].pose().t, Color(150, 150, 150, 2), true);
     iw.process(canvas);
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -428,21 +443,23 @@ void relativeSection(ImageWriter& iw)
     canvas = iw.nextCanvas();
     drawSoccerField(canvas);
 
-    geo::Vec2 ball_pos_rel = wm.entities[2].pose.inverse() * wm.entities[1].pose.t;
+    // Attach the ball to the turtle, so it turns along
+    geo::Transform2 turtle_pose = wm.entities()[2].pose();
+    wm.setParent(1, 2);
 
     geo::Transform2 offset = geo::Transform2::identity();
     offset.setRotation(-0.3);
 
-    wm.entities[2].pose = wm.entities[2].pose * offset;
-    wm.entities[1].pose.t = wm.entities[2].pose * ball_pos_rel;
+    wm.setPose(2, turtle_pose * offset);
+    wm.updatePoses();
 
     drawWorldModelSceneGraph(canvas, wm, links);
-    drawArrow(canvas, wm.entities[3].pose.t, wm.entities[1].pose.t, Color(150, 150, 150, 2), true);
+    drawArrow(canvas, wm.entities()[3].pose().t, wm.entities()[1].pose().t, Color(150, 150, 150, 2), true);
     iw.process(canvas);
 
     // Turn back
-    wm.entities[2].pose = wm.entities[2].pose * offset.inverse();
-    wm.entities[1].pose.t = wm.entities[2].pose * ball_pos_rel;
+    wm.setPose(2, turtle_pose);
+    wm.setParent(1, -1);
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -477,28 +494,26 @@ void relativeSection(ImageWriter& iw)
     drawWorldModelSceneGraph(canvas, wm, links);
     iw.process(canvas);
 
-    cv::Mat temp = canvas.image.clone();
-
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-    canvas = iw.nextCanvas();
-    canvas.image = temp.clone();
-
-    drawTriangle(canvas, wm.entities[1].pose.t, wm.entities[2].pose.t, wm.entities[4].pose.t, Color(0, 255, 255, 2));
+    // Continues on the previous frame (which has its own pixels)
+    drawTriangle(canvas, wm.entities()[1].pose().t, wm.entities()[2].pose().t, wm.entities()[4].pose().t, Color(0, 255, 255, 2));
 
     iw.process(canvas);
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
     // Replace 3th turtle by field feature
-    wm.entities[4] = Entity2D(Model2D(), fromXYA(0, 0.7, 0), Color());
+    wm.setShape(4, Model2DConstPtr(new Model2D));
+    wm.setColor(4, Color());
+    wm.setPose(4, fromXYA(0, 0.7, 0));
 
     canvas = iw.nextCanvas();
     drawSoccerField(canvas);
     drawWorldModelSceneGraph(canvas, wm, links);
     iw.process(canvas);
 
-    drawTriangle(canvas, wm.entities[1].pose.t, wm.entities[2].pose.t, wm.entities[4].pose.t, Color(0, 255, 255, 2));
+    drawTriangle(canvas, wm.entities()[1].pose().t, wm.entities()[2].pose().t, wm.entities()[4].pose().t, Color(0, 255, 255, 2));
 
     iw.process(canvas);
 
@@ -0,0 +1,155 @@
+#include "relative_pose.h"
+
+#include <algorithm>
+
+// ----------------------------------------------------------------------------------------------------
+
+RelativePoseQuery::RelativePoseQuery(const WorldModel2D& wm) : wm_(wm), structure_revision_(wm.structureRevision()), num_entities_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void RelativePoseQuery::sync()
+{
+    if (structure_revision_ == wm_.structureRevision() && num_entities_ == wm_.entities().size())
+        return;
+
+    structure_revision_ = wm_.structureRevision();
+    num_entities_ = wm_.entities().size();
+
+    depth_.assign(num_entities_, -1);
+    path_cache_.clear();
+    result_cache_.clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int RelativePoseQuery::depth(int i)
+{
+    int& d = depth_[i];
+    if (d < 0)
+    {
+        int i_parent = wm_.entities()[i].parent();
+        d = i_parent < 0 ? 0 : depth(i_parent) + 1;
+    }
+    return d;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+const RelativePoseQuery::Path& RelativePoseQuery::pathFrom(int i_ancestor, int i)
+{
+    static const Path identity = { geo::Transform2::identity(), 0 };
+    if (i == i_ancestor)
+        return identity;
+
+    // Bring the path to the parent up to date first; the path to i is only recomputed if that one or the
+    // local pose of i changed
+    const Entity2D& e = wm_.entities()[i];
+    const Path& parent_path = (e.parent() == i_ancestor) ? identity : pathFrom(i_ancestor, e.parent());
+    unsigned long revision = std::max(parent_path.revision, e.revision());
+
+    std::pair<std::map<std::pair<int, int>, Path>::iterator, bool> r
+            = path_cache_.insert(std::make_pair(std::make_pair(i_ancestor, i), Path()));
+
+    Path& path = r.first->second;
+    if (r.second || path.revision != revision)
+    {
+        path.t = parent_path.t * e.localPose();
+        path.revision = revision;
+    }
+
+    return path;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int RelativePoseQuery::commonAncestor(int i_a, int i_b)
+{
+    sync();
+
+    int d_a = depth(i_a);
+    int d_b = depth(i_b);
+
+    for(; d_a > d_b; --d_a)
+        i_a = wm_.entities()[i_a].parent();
+
+    for(; d_b > d_a; --d_b)
+        i_b = wm_.entities()[i_b].parent();
+
+    while(i_a != i_b)
+    {
+        i_a = wm_.entities()[i_a].parent();
+        i_b = wm_.entities()[i_b].parent();
+    }
+
+    return i_a;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::Transform2 RelativePoseQuery::query(int i_a, int i_b)
+{
+    sync();
+
+    std::pair<int, int> key(i_a, i_b);
+    std::map<std::pair<int, int>, Result>::iterator it = result_cache_.find(key);
+    if (it != result_cache_.end())
+    {
+        Result& res = it->second;
+        if (res.revision == wm_.revision())
+            return res.t;
+
+        // Something changed, but the result is still valid if its two paths did not
+        const Path& path_a = pathFrom(res.i_ancestor, i_a);
+        const Path& path_b = pathFrom(res.i_ancestor, i_b);
+        if (path_a.revision != res.revision_a || path_b.revision != res.revision_b)
+        {
+            res.t = path_b.t.inverse() * path_a.t;
+            res.revision_a = path_a.revision;
+            res.revision_b = path_b.revision;
+        }
+
+        res.revision = wm_.revision();
+        return res.t;
+    }
+
+    int i_lca = commonAncestor(i_a, i_b);
+    if (i_lca < 0)
+    {
+        // Different trees: go through the world frame. The poses of the roots are not part of any path, so
+        // this result is not cached.
+        int i_root_a = i_a;
+        while(wm_.entities()[i_root_a].parent() >= 0)
+            i_root_a = wm_.entities()[i_root_a].parent();
+
+        int i_root_b = i_b;
+        while(wm_.entities()[i_root_b].parent() >= 0)
+            i_root_b = wm_.entities()[i_root_b].parent();
+
+        geo::Transform2 a = wm_.entities()[i_root_a].pose() * pathFrom(i_root_a, i_a).t;
+        geo::Transform2 b = wm_.entities()[i_root_b].pose() * pathFrom(i_root_b, i_b).t;
+        return b.inverse() * a;
+    }
+
+    const Path& path_a = pathFrom(i_lca, i_a);
+    const Path& path_b = pathFrom(i_lca, i_b);
+
+    Result& res = result_cache_[key];
+    res.t = path_b.t.inverse() * path_a.t;
+    res.i_ancestor = i_lca;
+    res.revision = wm_.revision();
+    res.revision_a = path_a.revision;
+    res.revision_b = path_b.revision;
+    return res.t;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void RelativePoseQuery::query(const std::vector<std::pair<int, int> >& pairs, std::vector<geo::Transform2>& poses)
+{
+    poses.resize(pairs.size());
+    for(unsigned int k = 0; k < pairs.size(); ++k)
+        poses[k] = query(pairs[k].first, pairs[k].second);
+}
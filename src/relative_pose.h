@@ -0,0 +1,80 @@
+#ifndef _RELATIVE_POSE_H_
+#define _RELATIVE_POSE_H_
+
+#include "world_model.h"
+
+#include <map>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Answers "pose of entity A in the frame of entity B" on the transform tree of a world model. Within a
+// tree the answer is composed from the local poses on the paths from A and B up to their lowest common
+// ancestor, so it does not depend on anything above that ancestor. Path transforms and same-tree results
+// are cached. A cached path stays valid as long as none of the entities on it changed (checked with
+// Entity2D::revision()), so moving one subtree does not drop the paths in the others; only structure
+// changes (adding or removing entities, setParent) drop everything. Poses can only be changed through the
+// world model, which keeps these stamps. Entities in different trees are related through the (current)
+// world poses of their roots.
+
+class RelativePoseQuery
+{
+
+public:
+
+    RelativePoseQuery(const WorldModel2D& wm);
+
+    geo::Transform2 query(int i_a, int i_b);
+
+    // poses[k] = query(pairs[k].first, pairs[k].second)
+    void query(const std::vector<std::pair<int, int> >& pairs, std::vector<geo::Transform2>& poses);
+
+    // Lowest common ancestor of i_a and i_b (one of them if it is an ancestor of the other), or -1 if
+    // they are in different trees
+    int commonAncestor(int i_a, int i_b);
+
+private:
+
+    struct Path
+    {
+        geo::Transform2 t;
+
+        // Newest entity revision on the path: the path is up to date if this is still the newest
+        unsigned long revision;
+    };
+
+    struct Result
+    {
+        geo::Transform2 t;
+
+        int i_ancestor;
+
+        // World model revision at which the result was last checked, and the revisions of both paths
+        unsigned long revision;
+        unsigned long revision_a;
+        unsigned long revision_b;
+    };
+
+    const WorldModel2D& wm_;
+
+    unsigned long structure_revision_;
+
+    unsigned int num_entities_;
+
+    // Depth of each entity in its tree (0 for roots), -1 if not yet computed
+    std::vector<int> depth_;
+
+    // Pose of entity (second) in the frame of its ancestor (first)
+    std::map<std::pair<int, int>, Path> path_cache_;
+
+    std::map<std::pair<int, int>, Result> result_cache_;
+
+    void sync();
+
+    int depth(int i);
+
+    // Brings the cached path up to date if one of the entities on it changed
+    const Path& pathFrom(int i_ancestor, int i);
+
+};
+
+#endif
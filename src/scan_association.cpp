@@ -0,0 +1,62 @@
+#include "scan_association.h"
+
+#include <cmath>
+#include <algorithm>
+
+// ----------------------------------------------------------------------------------------------------
+
+void associateScans(const std::vector<double>& ranges_virtual, const std::vector<double>& ranges_real,
+                    const ScanAssociationParameters& params, ScanAssociation& result)
+{
+    int num_beams = std::min(ranges_virtual.size(), ranges_real.size());
+
+    // Invalid virtual ranges get a difference that can never be the minimum
+    const double no_range = 1e10;
+
+    std::vector<double> best(num_beams, no_range);
+
+    const double* rv = num_beams > 0 ? &ranges_virtual[0] : 0;
+    const double* rr = num_beams > 0 ? &ranges_real[0] : 0;
+    double* b = num_beams > 0 ? &best[0] : 0;
+
+    // Loop over the offsets in the outer loop, so the inner loop is a straight, branch-free pass over
+    // the beams that the compiler can vectorize
+    for(int k = -params.beam_window; k <= params.beam_window; ++k)
+    {
+        int i_min = std::max(0, -k);
+        int i_max = std::min(num_beams, num_beams - k);
+
+        for(int i = i_min; i < i_max; ++i)
+        {
+            double v = rv[i + k];
+            double d = std::abs(rr[i] - v) + (v > 0 ? 0 : no_range);
+            b[i] = std::min(b[i], d);
+        }
+    }
+
+    result.associated.assign(num_beams, 0);
+    result.unassociated.assign(num_beams, 0);
+    result.range_differences.assign(num_beams, -1);
+    result.num_associated = 0;
+    result.num_unassociated = 0;
+
+    for(int i = 0; i < num_beams; ++i)
+    {
+        if (rr[i] <= 0)
+            continue;
+
+        if (b[i] < no_range)
+            result.range_differences[i] = b[i];
+
+        if (b[i] <= params.max_range_difference)
+        {
+            result.associated[i] = 1;
+            ++result.num_associated;
+        }
+        else
+        {
+            result.unassociated[i] = 1;
+            ++result.num_unassociated;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef _SCAN_ASSOCIATION_H_
+#define _SCAN_ASSOCIATION_H_
+
+#include <vector>
+
+// ----------------------------------------------------------------------------------------------------
+
+struct ScanAssociationParameters
+{
+    ScanAssociationParameters() : max_range_difference(0.1), beam_window(1) {}
+
+    // A real beam is associated if its range is within this distance (m) of a virtual range ...
+    double max_range_difference;
+
+    // ... of the same beam or one of the beam_window neighbouring beams on either side
+    int beam_window;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+struct ScanAssociation
+{
+    // Per beam of the real scan. Beams without a valid real range are in neither mask.
+    std::vector<unsigned char> associated;
+    std::vector<unsigned char> unassociated;
+
+    // Smallest range difference found within the window (or -1 if none)
+    std::vector<double> range_differences;
+
+    int num_associated;
+    int num_unassociated;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Associates a real scan with a virtual (rendered) scan taken from the same sensor pose. Both scans must
+// have the same number of beams. Works purely on the ranges, independent of any canvas.
+void associateScans(const std::vector<double>& ranges_virtual, const std::vector<double>& ranges_real,
+                    const ScanAssociationParameters& params, ScanAssociation& result);
+
+#endif
@@ -0,0 +1,400 @@
+#include "scan_matcher.h"
+
+#include "world_model.h"
+
+#include <algorithm>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+double dot(const geo::Vec2& v1, const geo::Vec2& v2)
+{
+    return v1.x * v2.x + v1.y * v2.y;
+}
+
+geo::Vec2 closestPointOnSegment(const LineSegment2D& s, const geo::Vec2& p)
+{
+    geo::Vec2 d = s.p2 - s.p1;
+    double l2 = dot(d, d);
+    if (l2 <= 0)
+        return s.p1;
+
+    double t = std::max(0.0, std::min(1.0, dot(p - s.p1, d) / l2));
+    return s.p1 + d * t;
+}
+
+// Solves the symmetric 3x3 system A x = b using Cramer's rule
+bool solve3x3(const double A[3][3], const double b[3], double x[3])
+{
+    double det = A[0][0] * (A[1][1] * A[2][2] - A[1][2] * A[2][1])
+               - A[0][1] * (A[1][0] * A[2][2] - A[1][2] * A[2][0])
+               + A[0][2] * (A[1][0] * A[2][1] - A[1][1] * A[2][0]);
+
+    if (std::abs(det) < 1e-12)
+        return false;
+
+    for(int k = 0; k < 3; ++k)
+    {
+        double M[3][3];
+        for(int i = 0; i < 3; ++i)
+            for(int j = 0; j < 3; ++j)
+                M[i][j] = (j == k) ? b[i] : A[i][j];
+
+        x[k] = (M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1])
+              - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+              + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0])) / det;
+    }
+
+    return true;
+}
+
+struct Correspondence
+{
+    geo::Vec2 q;        // scan point in world frame
+    geo::Vec2 normal;   // unit normal of the matched segment
+    double error;       // signed point-to-line distance
+};
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+SegmentGrid::SegmentGrid(double cell_size) : cell_size_(cell_size), cols_(0), rows_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SegmentGrid::clear()
+{
+    segments_.clear();
+    cell_offsets_.clear();
+    cell_segments_.clear();
+    cols_ = 0;
+    rows_ = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SegmentGrid::addSegment(const geo::Vec2& p1, const geo::Vec2& p2)
+{
+    segments_.push_back(LineSegment2D(p1, p2));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SegmentGrid::addWorldModel(const WorldModel2D& wm)
+{
+    wm.updatePoses();
+
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
+    {
+        const Entity2D& e = wm.entities()[i];
+
+        for(std::vector<Contour2D>::const_iterator it = e.shape->contours.begin(); it != e.shape->contours.end(); ++it)
+        {
+            const Contour2D& c = *it;
+
+            // A two-point contour is a single line, do not add it twice
+            unsigned int num_segments = c.points.size() == 2 ? 1 : c.points.size();
+
+            for(unsigned int j = 0; j < num_segments; ++j)
+                addSegment(e.pose() * c.points[j], e.pose() * c.points[(j + 1) % c.points.size()]);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SegmentGrid::addScan(const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
+                          double max_gap)
+{
+    bool has_previous = false;
+    geo::Vec2 p_previous;
+
+    for(unsigned int i = 0; i < ranges.size(); ++i)
+    {
+        double r = ranges[i];
+        if (r <= 0)
+        {
+            has_previous = false;
+            continue;
+        }
+
+        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+        geo::Vec2 p = lrf_pose * geo::Vec2(r * ray_dir.x, r * ray_dir.y);
+
+        if (has_previous && (p - p_previous).length() <= max_gap)
+            addSegment(p_previous, p);
+
+        p_previous = p;
+        has_previous = true;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SegmentGrid::cellRange(const LineSegment2D& s, int& x_min, int& y_min, int& x_max, int& y_max) const
+{
+    x_min = (std::min(s.p1.x, s.p2.x) - origin_.x) / cell_size_;
+    y_min = (std::min(s.p1.y, s.p2.y) - origin_.y) / cell_size_;
+    x_max = (std::max(s.p1.x, s.p2.x) - origin_.x) / cell_size_;
+    y_max = (std::max(s.p1.y, s.p2.y) - origin_.y) / cell_size_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SegmentGrid::build()
+{
+    cell_offsets_.clear();
+    cell_segments_.clear();
+
+    if (segments_.empty())
+    {
+        cols_ = 0;
+        rows_ = 0;
+        return;
+    }
+
+    geo::Vec2 p_min(1e9, 1e9);
+    geo::Vec2 p_max(-1e9, -1e9);
+    for(unsigned int i = 0; i < segments_.size(); ++i)
+    {
+        const LineSegment2D& s = segments_[i];
+        p_min.x = std::min(p_min.x, std::min(s.p1.x, s.p2.x));
+        p_min.y = std::min(p_min.y, std::min(s.p1.y, s.p2.y));
+        p_max.x = std::max(p_max.x, std::max(s.p1.x, s.p2.x));
+        p_max.y = std::max(p_max.y, std::max(s.p1.y, s.p2.y));
+    }
+
+    origin_ = p_min;
+    cols_ = (p_max.x - p_min.x) / cell_size_ + 1;
+    rows_ = (p_max.y - p_min.y) / cell_size_ + 1;
+
+    // A cell overlaps a segment if its center lies within half a cell diagonal of it
+    double r_cell = cell_size_ * 0.7072;
+
+    // First pass counts, second pass fills
+    std::vector<int> counts(cols_ * rows_ + 1, 0);
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        for(unsigned int i = 0; i < segments_.size(); ++i)
+        {
+            const LineSegment2D& s = segments_[i];
+
+            int x_min, y_min, x_max, y_max;
+            cellRange(s, x_min, y_min, x_max, y_max);
+
+            for(int y = y_min; y <= y_max; ++y)
+            {
+                for(int x = x_min; x <= x_max; ++x)
+                {
+                    geo::Vec2 c = origin_ + geo::Vec2((x + 0.5) * cell_size_, (y + 0.5) * cell_size_);
+                    if ((closestPointOnSegment(s, c) - c).length() > r_cell)
+                        continue;
+
+                    int k = y * cols_ + x;
+                    if (pass == 0)
+                        ++counts[k];
+                    else
+                        cell_segments_[--counts[k]] = i;
+                }
+            }
+        }
+
+        if (pass == 0)
+        {
+            // Convert counts to end offsets; the second pass decrements them to start offsets
+            for(unsigned int k = 1; k < counts.size(); ++k)
+                counts[k] += counts[k - 1];
+            cell_segments_.resize(counts.back());
+        }
+    }
+
+    cell_offsets_ = counts;
+    cell_offsets_.back() = cell_segments_.size();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int SegmentGrid::findNearest(const geo::Vec2& p, double max_dist, geo::Vec2& closest) const
+{
+    if (cols_ == 0)
+        return -1;
+
+    int x_min = std::max(0, (int)floor((p.x - max_dist - origin_.x) / cell_size_));
+    int y_min = std::max(0, (int)floor((p.y - max_dist - origin_.y) / cell_size_));
+    int x_max = std::min(cols_ - 1, (int)floor((p.x + max_dist - origin_.x) / cell_size_));
+    int y_max = std::min(rows_ - 1, (int)floor((p.y + max_dist - origin_.y) / cell_size_));
+
+    int i_best = -1;
+    double d2_best = max_dist * max_dist;
+
+    for(int y = y_min; y <= y_max; ++y)
+    {
+        for(int x = x_min; x <= x_max; ++x)
+        {
+            int k = y * cols_ + x;
+            for(int j = cell_offsets_[k]; j < cell_offsets_[k + 1]; ++j)
+            {
+                int i = cell_segments_[j];
+                geo::Vec2 c = closestPointOnSegment(segments_[i], p);
+                geo::Vec2 diff = c - p;
+                double d2 = dot(diff, diff);
+                if (d2 < d2_best)
+                {
+                    d2_best = d2;
+                    i_best = i;
+                    closest = c;
+                }
+            }
+        }
+    }
+
+    return i_best;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool matchScan(const geo::LaserRangeFinder& lrf, const std::vector<double>& ranges, const SegmentGrid& reference,
+               geo::Transform2& pose, const ScanMatchParameters& params, ScanMatchResult* result)
+{
+    ScanMatchResult res;
+
+    std::vector<geo::Vec2> scan_points;
+    scan_points.reserve(ranges.size());
+    for(unsigned int i = 0; i < ranges.size(); ++i)
+    {
+        double r = ranges[i];
+        if (r <= 0)
+            continue;
+
+        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+        scan_points.push_back(geo::Vec2(r * ray_dir.x, r * ray_dir.y));
+    }
+
+    std::vector<Correspondence> correspondences;
+    correspondences.reserve(scan_points.size());
+    std::vector<double> abs_errors;
+    abs_errors.reserve(scan_points.size());
+
+    bool ok = true;
+
+    for(res.iterations = 0; res.iterations < params.max_iterations; ++res.iterations)
+    {
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Find point-to-line correspondences
+
+        correspondences.clear();
+        abs_errors.clear();
+
+        for(unsigned int i = 0; i < scan_points.size(); ++i)
+        {
+            Correspondence c;
+            c.q = pose * scan_points[i];
+
+            geo::Vec2 closest;
+            int i_segment = reference.findNearest(c.q, params.max_correspondence_distance, closest);
+            if (i_segment < 0)
+                continue;
+
+            const LineSegment2D& s = reference.segments()[i_segment];
+            geo::Vec2 d = s.p2 - s.p1;
+            if (d.length() < 1e-9)
+                continue;
+
+            c.normal = geo::Vec2(-d.y, d.x).normalized();
+            c.error = dot(c.normal, c.q - closest);
+
+            correspondences.push_back(c);
+            abs_errors.push_back(std::abs(c.error));
+        }
+
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Outlier rejection: only keep the best fraction
+
+        double max_error = params.max_correspondence_distance;
+        if (params.inlier_fraction < 1 && !abs_errors.empty())
+        {
+            unsigned int n = std::max(1, (int)(params.inlier_fraction * abs_errors.size())) - 1;
+            std::nth_element(abs_errors.begin(), abs_errors.begin() + n, abs_errors.end());
+            max_error = abs_errors[n];
+        }
+
+        geo::Vec2 m(0, 0);
+        int num_inliers = 0;
+        for(unsigned int i = 0; i < correspondences.size(); ++i)
+        {
+            if (std::abs(correspondences[i].error) <= max_error)
+            {
+                m += correspondences[i].q;
+                ++num_inliers;
+            }
+        }
+
+        res.num_correspondences = num_inliers;
+
+        if (num_inliers < params.min_correspondences)
+        {
+            ok = false;
+            break;
+        }
+
+        m = m * (1.0 / num_inliers);
+
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Linearize around the inlier centroid and solve for (dx, dy, da)
+
+        double A[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+        double b[3] = {0, 0, 0};
+        double total_error = 0;
+
+        for(unsigned int i = 0; i < correspondences.size(); ++i)
+        {
+            const Correspondence& c = correspondences[i];
+            if (std::abs(c.error) > max_error)
+                continue;
+
+            geo::Vec2 v = c.q - m;
+            double J[3] = { c.normal.x, c.normal.y, c.normal.y * v.x - c.normal.x * v.y };
+
+            for(int k = 0; k < 3; ++k)
+            {
+                for(int l = 0; l < 3; ++l)
+                    A[k][l] += J[k] * J[l];
+                b[k] -= J[k] * c.error;
+            }
+
+            total_error += std::abs(c.error);
+        }
+
+        res.mean_error = total_error / num_inliers;
+
+        double x[3];
+        if (!solve3x3(A, b, x))
+        {
+            ok = false;
+            break;
+        }
+
+        // Rotate by da around m, then translate by (dx, dy)
+        geo::Transform2 delta = fromXYA(0, 0, x[2]);
+        delta.t = m + geo::Vec2(x[0], x[1]) - delta.R * m;
+        pose = delta * pose;
+
+        if (std::abs(x[0]) < params.translation_epsilon && std::abs(x[1]) < params.translation_epsilon
+                && std::abs(x[2]) < params.rotation_epsilon)
+        {
+            res.converged = true;
+            ++res.iterations;
+            break;
+        }
+    }
+
+    if (result)
+        *result = res;
+
+    return ok;
+}
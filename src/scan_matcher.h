@@ -0,0 +1,113 @@
+#ifndef _SCAN_MATCHER_H_
+#define _SCAN_MATCHER_H_
+
+#include "canvas.h"
+
+#include <geolib/sensors/LaserRangeFinder.h>
+
+struct WorldModel2D;
+
+// ----------------------------------------------------------------------------------------------------
+
+struct LineSegment2D
+{
+    LineSegment2D() {}
+    LineSegment2D(const geo::Vec2& p1_, const geo::Vec2& p2_) : p1(p1_), p2(p2_) {}
+
+    geo::Vec2 p1;
+    geo::Vec2 p2;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Uniform grid over line segments (in world coordinates) for nearest segment lookups. Add segments,
+// then call build() before querying.
+
+class SegmentGrid
+{
+
+public:
+
+    SegmentGrid(double cell_size = 0.25);
+
+    void clear();
+
+    void addSegment(const geo::Vec2& p1, const geo::Vec2& p2);
+
+    void addWorldModel(const WorldModel2D& wm);
+
+    // Connects consecutive scan end points that are at most max_gap apart
+    void addScan(const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose, const std::vector<double>& ranges,
+                 double max_gap = 0.3);
+
+    void build();
+
+    // Returns the index of the nearest segment within max_dist of p (or -1 if there is none) and the
+    // closest point on that segment
+    int findNearest(const geo::Vec2& p, double max_dist, geo::Vec2& closest) const;
+
+    const std::vector<LineSegment2D>& segments() const { return segments_; }
+
+    double cellSize() const { return cell_size_; }
+
+    bool empty() const { return segments_.empty(); }
+
+private:
+
+    double cell_size_;
+
+    std::vector<LineSegment2D> segments_;
+
+    // Grid in compressed row layout: indices of the segments in cell i are
+    // cell_segments_[cell_offsets_[i]] ... cell_segments_[cell_offsets_[i + 1] - 1]
+    geo::Vec2 origin_;
+    int cols_;
+    int rows_;
+    std::vector<int> cell_offsets_;
+    std::vector<int> cell_segments_;
+
+    void cellRange(const LineSegment2D& s, int& x_min, int& y_min, int& x_max, int& y_max) const;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+struct ScanMatchParameters
+{
+    ScanMatchParameters()
+        : max_iterations(30), max_correspondence_distance(0.5), inlier_fraction(0.8), min_correspondences(6),
+          translation_epsilon(1e-4), rotation_epsilon(1e-4) {}
+
+    int max_iterations;
+
+    // Scan points further than this from any segment are not used
+    double max_correspondence_distance;
+
+    // Per iteration, only this fraction of the correspondences with the smallest residuals is used
+    double inlier_fraction;
+
+    int min_correspondences;
+
+    double translation_epsilon;
+    double rotation_epsilon;
+};
+
+struct ScanMatchResult
+{
+    ScanMatchResult() : iterations(0), num_correspondences(0), mean_error(0), converged(false) {}
+
+    int iterations;
+    int num_correspondences;
+    double mean_error;
+    bool converged;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Point-to-line ICP: refines 'pose' (initially the guessed sensor pose) such that the scan aligns with
+// the reference segments. Returns false if there were too few correspondences to compute an update.
+bool matchScan(const geo::LaserRangeFinder& lrf, const std::vector<double>& ranges, const SegmentGrid& reference,
+               geo::Transform2& pose, const ScanMatchParameters& params = ScanMatchParameters(),
+               ScanMatchResult* result = 0);
+
+#endif
@@ -3,16 +3,30 @@
 #include "image_writer.h"
 #include "world_model.h"
 #include "lrf.h"
+#include "scan_association.h"
+#include "beam_clustering.h"
+#include "blend.h"
 
 // ----------------------------------------------------------------------------------------------------
 
-cv::Mat createWatermark(const cv::Mat& image, const cv::Vec3b& blend_color, double blend_alpha)
+cv::Mat createWatermark(const Canvas& canvas, const cv::Vec3b& blend_color, double blend_alpha)
 {
-    cv::Mat watermark(image.rows, image.cols, CV_8UC3);
-    for(unsigned int i = 0; i < image.cols * image.rows; ++i)
+    cv::Scalar color(blend_color[0], blend_color[1], blend_color[2]);
+
+    cv::Mat watermark;
+    if (canvas.palette)
+    {
+        // Blend the palette colors instead of the pixels
+        cv::Mat lut(1, 256, CV_8UC1, cv::Scalar(0));
+        int num_colors = canvas.palette->colors().size();
+        for(int i = 0; i < num_colors; ++i)
+            lut.at<unsigned char>(0, i) = canvas.palette->blend(i, color, cvRound(blend_alpha * 255));
+
+        cv::LUT(canvas.image, lut, watermark);
+    }
+    else
     {
-        const cv::Vec3b& oc = image.at<cv::Vec3b>(i);
-        watermark.at<cv::Vec3b>(i) = blend_alpha * blend_color + (1 - blend_alpha) * oc;
+        blendConstant(canvas.image, color, blend_alpha, watermark);
     }
 
     return watermark;
@@ -78,7 +92,11 @@ void segmentationSection(ImageWriter& iw)
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     // Show association
 
-    cv::Mat watermark = createWatermark(canvas.image, cv::Vec3b(255, 255, 255), 0.5);
+    ScanAssociationParameters association_params;
+    ScanAssociation association;
+    associateScans(ranges_virtual, ranges_real, association_params, association);
+
+    cv::Mat watermark = createWatermark(canvas, cv::Vec3b(255, 255, 255), 0.5);
 
     std::vector<cv::Point> points_virtual;
     std::vector<cv::Point> points_real;
@@ -87,10 +105,17 @@ void segmentationSection(ImageWriter& iw)
 
     std::vector<cv::Point> non_associated;
 
+    canvas = iw.nextCanvas();
+    canvas.modify();
+    watermark.copyTo(canvas.image);
+    CanvasSnapshot watermark_snapshot = canvas.snapshot();
+
     for(unsigned int i = 0; i < ranges_real.size(); ++i)
     {
-        canvas = iw.nextCanvas();
-        canvas.image = watermark.clone();
+        if (!association.unassociated[i] && i > 5 && i % 5 != 0)
+            continue;
+
+        canvas.restore(watermark_snapshot);
 
         const cv::Point& p1 = points_virtual[i];
         const cv::Point& p2 = points_real[i];
@@ -98,22 +123,20 @@ void segmentationSection(ImageWriter& iw)
         cv::Point diff = p1 - p2;
 
         double dist = sqrt(diff.x * diff.x + diff.y * diff.y);
-        if (dist < 8 && i > 5 && i % 5 != 0)
-            continue;
-
         double length = std::max<int>(10, dist / 2 + 15);
         double a = lrf.getAngles()[i];
 
-        cv::ellipse(canvas.image, 0.5 * (p1 + p2), cv::Size(10, length), a / M_PI * 180, 0, 360, cv::Scalar(0, 0, 255), 2);
+        canvas.modify(0.5 * (p1 + p2), length + 3);
+        cv::ellipse(canvas.image, 0.5 * (p1 + p2), cv::Size(10, length), a / M_PI * 180, 0, 360, canvas.ink(cv::Scalar(0, 0, 255)), 2);
 
-        if (dist > 8)
-        {
-            // no association
+        if (association.unassociated[i])
             non_associated.push_back(p2);
-        }
 
         for(std::vector<cv::Point>::const_iterator it = non_associated.begin(); it != non_associated.end(); ++it)
-            cv::circle(canvas.image, *it, 5, cv::Scalar(255, 0, 0), 2);
+        {
+            canvas.modify(*it, 7);
+            cv::circle(canvas.image, *it, 5, canvas.ink(cv::Scalar(255, 0, 0)), 2);
+        }
 
         iw.process(canvas);
     }
@@ -124,22 +147,19 @@ void segmentationSection(ImageWriter& iw)
     drawWorld(canvas, wm);
 
     for(std::vector<cv::Point>::const_iterator it = non_associated.begin(); it != non_associated.end(); ++it)
-        cv::circle(canvas.image, *it, 5, cv::Scalar(255, 0, 0), 2);
+    {
+        canvas.modify(*it, 7);
+        cv::circle(canvas.image, *it, 5, canvas.ink(cv::Scalar(255, 0, 0)), 2);
+    }
 
     iw.process(canvas);
 
-    Model2D new_model;
-    Contour2D& new_contour = new_model.addContour();
-
-    for(unsigned int i = 0; i < non_associated.size(); ++i)
-    {
-        const cv::Point& p1_image = non_associated[i];
-        geo::Vec2 p1_world = canvas.imageToWorld(p1_image);
-
-        new_contour.addPoint(p1_world.x, p1_world.y);
-    }
+    // One new entity per cluster of non-associated beams
+    std::vector<BeamCluster> clusters;
+    clusterBeams(lrf, lrf_pose_real, ranges_real, association.unassociated, BeamClusteringParameters(), clusters);
 
-    wm.addEntity(new_model, geo::Transform2::identity());
+    unsigned int num_known_entities = wm.entities().size();
+    addClusterEntities(clusters, wm);
     drawWorld(canvas, wm);
 
     iw.process(canvas);
@@ -170,23 +190,23 @@ void segmentationSection(ImageWriter& iw)
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-    rangesToImagePoints(canvas, lrf, lrf_pose, ranges_virtual, points_virtual);
+    associateScans(ranges_virtual, ranges_real, association_params, association);
     rangesToImagePoints(canvas, lrf, lrf_pose_real, ranges_real, points_real);
 
     for(unsigned int i = 0; i < ranges_real.size(); ++i)
     {
-        double rv = ranges_virtual[i];
-        double rr = ranges_real[i];
-
-        if (std::abs(rv - rr) > 0.1)
-            cv::circle(canvas.image, points_real[i], 5, cv::Scalar(255, 0, 0), 2);
+        if (association.unassociated[i])
+        {
+            canvas.modify(points_real[i], 7);
+            cv::circle(canvas.image, points_real[i], 5, canvas.ink(cv::Scalar(255, 0, 0)), 2);
+        }
     }
 
     iw.process(canvas);
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-    wm.entities.pop_back();
+    wm.truncate(num_known_entities);
     wm.addEntity(createBox(0.8, 0.8), fromXYA(1.5, -1.5, 0), Color(0, 0, 0, 2));
 
     canvas = iw.nextCanvas();
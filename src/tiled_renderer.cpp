@@ -0,0 +1,145 @@
+#include "tiled_renderer.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+struct Tile
+{
+    cv::Rect rect;
+
+    // Area that is drawn into: the tile and the bounding boxes of its commands, clipped to the image
+    cv::Rect scratch_rect;
+
+    std::vector<int> commands;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+class DrawTiles : public cv::ParallelLoopBody
+{
+
+public:
+
+    DrawTiles(const DisplayList& list, const Canvas& canvas, const cv::Mat& original, const cv::Rect& original_rect,
+              std::vector<Tile>& tiles)
+        : list_(list), canvas_(canvas), original_(original), original_rect_(original_rect), tiles_(tiles) {}
+
+    void operator()(const cv::Range& r) const
+    {
+        for(int i = r.start; i < r.end; ++i)
+        {
+            const Tile& tile = tiles_[i];
+            if (tile.commands.empty())
+                continue;
+
+            Canvas scratch(1, 1, canvas_.background_color, canvas_.palette);
+            scratch.image = original_(tile.scratch_rect - original_rect_.tl()).clone();
+            scratch.pixels_per_meter = canvas_.pixels_per_meter;
+            scratch.center = canvas_.center;
+
+            list_.draw(scratch, tile.commands, tile.scratch_rect.tl());
+
+            cv::Mat roi = canvas_.image(tile.rect);
+            scratch.image(tile.rect - tile.scratch_rect.tl()).copyTo(roi);
+        }
+    }
+
+private:
+
+    const DisplayList& list_;
+    const Canvas& canvas_;
+    const cv::Mat& original_;
+    const cv::Rect& original_rect_;
+    std::vector<Tile>& tiles_;
+};
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TiledRenderer::TiledRenderer(int tile_size, int min_commands) : tile_size_(tile_size), min_commands_(min_commands)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TiledRenderer::draw(Canvas& canvas, const DisplayList& list) const
+{
+    int num_tiles_x = (canvas.image.cols + tile_size_ - 1) / tile_size_;
+    int num_tiles_y = (canvas.image.rows + tile_size_ - 1) / tile_size_;
+
+    if ((int)list.size() < min_commands_ || num_tiles_x * num_tiles_y < 2)
+    {
+        list.draw(canvas);
+        return;
+    }
+
+    cv::Rect image_rect(0, 0, canvas.image.cols, canvas.image.rows);
+
+    std::vector<Tile> tiles(num_tiles_x * num_tiles_y);
+    for(int ty = 0; ty < num_tiles_y; ++ty)
+    {
+        for(int tx = 0; tx < num_tiles_x; ++tx)
+        {
+            Tile& tile = tiles[ty * num_tiles_x + tx];
+            tile.rect = cv::Rect(tx * tile_size_, ty * tile_size_, tile_size_, tile_size_) & image_rect;
+            tile.scratch_rect = tile.rect;
+        }
+    }
+
+    // Bin the commands, keeping their order
+    for(unsigned int i = 0; i < list.size(); ++i)
+    {
+        cv::Rect bb = list.boundingBox(i, canvas);
+        cv::Rect visible = bb & image_rect;
+        if (visible.area() == 0)
+            continue;
+
+        int tx_min = visible.x / tile_size_;
+        int ty_min = visible.y / tile_size_;
+        int tx_max = (visible.x + visible.width - 1) / tile_size_;
+        int ty_max = (visible.y + visible.height - 1) / tile_size_;
+
+        for(int ty = ty_min; ty <= ty_max; ++ty)
+        {
+            for(int tx = tx_min; tx <= tx_max; ++tx)
+            {
+                Tile& tile = tiles[ty * num_tiles_x + tx];
+                tile.commands.push_back(i);
+                tile.scratch_rect = tile.scratch_rect | visible;
+            }
+        }
+    }
+
+    // The tiles only look up palette indices, adding colors is not thread-safe. Images are quantized to
+    // the existing colors, their (unused) command color must not take a palette entry.
+    if (canvas.palette)
+    {
+        for(unsigned int i = 0; i < list.size(); ++i)
+        {
+            if (list.command(i).type != DisplayList::IMAGE)
+                canvas.ink(list.command(i).color.color);
+        }
+    }
+
+    cv::Rect original_rect;
+    for(unsigned int i = 0; i < tiles.size(); ++i)
+    {
+        if (tiles[i].commands.empty())
+            continue;
+
+        canvas.modify(tiles[i].rect);
+        original_rect = original_rect.area() == 0 ? tiles[i].scratch_rect : (original_rect | tiles[i].scratch_rect);
+    }
+
+    if (original_rect.area() == 0)
+        return;
+
+    // Scratch areas overlap neighbouring tiles, which are being written to. Only the area they cover is
+    // copied.
+    cv::Mat original = canvas.image(original_rect).clone();
+
+    cv::parallel_for_(cv::Range(0, tiles.size()), DrawTiles(list, canvas, original, original_rect, tiles));
+}
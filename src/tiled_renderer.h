@@ -0,0 +1,32 @@
+#ifndef _TILED_RENDERER_H_
+#define _TILED_RENDERER_H_
+
+#include "display_list.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+// Draws a display list in parallel by splitting the image in tiles. Commands are binned per tile by
+// their bounding box. Each tile draws its commands, in list order, into a scratch copy of the original
+// image that covers the tile and the full bounding boxes of those commands, so that nothing is clipped
+// differently than when drawing serially; only the tile itself is copied back. The result is the same
+// as DisplayList::draw.
+
+class TiledRenderer
+{
+
+public:
+
+    TiledRenderer(int tile_size = 256, int min_commands = 64);
+
+    void draw(Canvas& canvas, const DisplayList& list) const;
+
+private:
+
+    int tile_size_;
+
+    // Smaller lists are not worth the overhead
+    int min_commands_;
+
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "world_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+// ----------------------------------------------------------------------------------------------------
+
+bool writeWorldFile(const std::string& filename, const WorldModel2D& wm)
+{
+    wm.updatePoses();
+
+    // Give every distinct shape an index
+    std::map<const Model2D*, uint32_t> shape_index;
+    std::vector<const Model2D*> shapes;
+
+    std::vector<WorldFileEntity> entities(wm.entities().size());
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
+    {
+        const Entity2D& e = wm.entities()[i];
+
+        std::map<const Model2D*, uint32_t>::iterator it = shape_index.find(e.shape.get());
+        if (it == shape_index.end())
+        {
+            it = shape_index.insert(std::make_pair(e.shape.get(), (uint32_t)shapes.size())).first;
+            shapes.push_back(e.shape.get());
+        }
+
+        geo::Vec2 col0 = e.pose().R * geo::Vec2(1, 0);
+        geo::Vec2 col1 = e.pose().R * geo::Vec2(0, 1);
+
+        WorldFileEntity& r = entities[i];
+        std::memset(&r, 0, sizeof(r));
+        r.t[0] = e.pose().t.x;
+        r.t[1] = e.pose().t.y;
+        r.R[0] = col0.x;
+        r.R[1] = col1.x;
+        r.R[2] = col0.y;
+        r.R[3] = col1.y;
+        r.parent = e.parent();
+        r.shape = it->second;
+        r.color_valid = e.color.valid;
+        if (e.color.valid)
+        {
+            for(int k = 0; k < 3; ++k)
+                r.color[k] = (unsigned char)e.color.color[k];
+            r.thickness = e.color.thickness;
+        }
+    }
+
+    std::vector<WorldFileShape> shape_records(shapes.size());
+    std::vector<uint64_t> contour_offsets(1, 0);
+    std::vector<double> points;
+
+    for(unsigned int i = 0; i < shapes.size(); ++i)
+    {
+        const std::vector<Contour2D>& contours = shapes[i]->contours;
+
+        shape_records[i].first_contour = contour_offsets.size() - 1;
+        shape_records[i].num_contours = contours.size();
+
+        for(unsigned int j = 0; j < contours.size(); ++j)
+        {
+            const std::vector<geo::Vec2>& c_points = contours[j].points;
+            for(unsigned int k = 0; k < c_points.size(); ++k)
+            {
+                points.push_back(c_points[k].x);
+                points.push_back(c_points[k].y);
+            }
+            contour_offsets.push_back(points.size() / 2);
+        }
+    }
+
+    WorldFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "WM2D", 4);
+    header.version = WORLD_FILE_VERSION;
+    header.num_entities = entities.size();
+    header.num_shapes = shape_records.size();
+    header.num_contours = contour_offsets.size() - 1;
+    header.num_points = points.size() / 2;
+
+    std::ofstream f(filename.c_str(), std::ios::binary);
+    if (!f.is_open())
+    {
+        std::cout << "Could not open '" << filename << "' for writing" << std::endl;
+        return false;
+    }
+
+    f.write((const char*)&header, sizeof(header));
+    if (!entities.empty())
+        f.write((const char*)&entities[0], entities.size() * sizeof(WorldFileEntity));
+    if (!shape_records.empty())
+        f.write((const char*)&shape_records[0], shape_records.size() * sizeof(WorldFileShape));
+    f.write((const char*)&contour_offsets[0], contour_offsets.size() * sizeof(uint64_t));
+    if (!points.empty())
+        f.write((const char*)&points[0], points.size() * sizeof(double));
+
+    return f.good();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+WorldFileView::WorldFileView() : data_(0), size_(0), header_(0), entities_(0), shapes_(0), contour_offsets_(0), points_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+WorldFileView::~WorldFileView()
+{
+    close();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool WorldFileView::open(const std::string& filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cout << "Could not open world file '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(WorldFileHeader))
+    {
+        std::cout << "World file '" << filename << "' is too small" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        std::cout << "Could not map world file '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    data_ = data;
+    size_ = st.st_size;
+
+    const char* p = (const char*)data_;
+    header_ = (const WorldFileHeader*)p;
+
+    if (std::memcmp(header_->magic, "WM2D", 4) != 0 || header_->version != WORLD_FILE_VERSION)
+    {
+        std::cout << "'" << filename << "' is not a world file of version " << WORLD_FILE_VERSION << std::endl;
+        close();
+        return false;
+    }
+
+    uint64_t expected_size = sizeof(WorldFileHeader)
+            + (uint64_t)header_->num_entities * sizeof(WorldFileEntity)
+            + (uint64_t)header_->num_shapes * sizeof(WorldFileShape)
+            + ((uint64_t)header_->num_contours + 1) * sizeof(uint64_t)
+            + header_->num_points * 2 * sizeof(double);
+
+    if (expected_size != size_)
+    {
+        std::cout << "World file '" << filename << "' has the wrong size" << std::endl;
+        close();
+        return false;
+    }
+
+    p += sizeof(WorldFileHeader);
+    entities_ = (const WorldFileEntity*)p;
+    p += header_->num_entities * sizeof(WorldFileEntity);
+    shapes_ = (const WorldFileShape*)p;
+    p += header_->num_shapes * sizeof(WorldFileShape);
+    contour_offsets_ = (const uint64_t*)p;
+    p += (header_->num_contours + 1) * sizeof(uint64_t);
+    points_ = (const double*)p;
+
+    // Check all indices once, so the accessors do not have to. The points themselves are not touched.
+    bool valid = (contour_offsets_[0] == 0 && contour_offsets_[header_->num_contours] == header_->num_points);
+    for(unsigned int i = 0; valid && i < header_->num_contours; ++i)
+        valid = contour_offsets_[i] <= contour_offsets_[i + 1];
+
+    for(unsigned int i = 0; valid && i < header_->num_shapes; ++i)
+        valid = (uint64_t)shapes_[i].first_contour + shapes_[i].num_contours <= header_->num_contours;
+
+    for(unsigned int i = 0; valid && i < header_->num_entities; ++i)
+        valid = entities_[i].shape < header_->num_shapes && entities_[i].parent < (int32_t)header_->num_entities;
+
+    if (!valid)
+    {
+        std::cout << "World file '" << filename << "' is corrupt" << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldFileView::close()
+{
+    if (data_)
+        munmap(data_, size_);
+
+    data_ = 0;
+    size_ = 0;
+    header_ = 0;
+    entities_ = 0;
+    shapes_ = 0;
+    contour_offsets_ = 0;
+    points_ = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::Transform2 WorldFileView::pose(unsigned int i) const
+{
+    const WorldFileEntity& e = entities_[i];
+
+    geo::Transform2 t;
+    t.R = geo::Mat2(e.R[0], e.R[1], e.R[2], e.R[3]);
+    t.t = geo::Vec2(e.t[0], e.t[1]);
+    return t;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+Color WorldFileView::color(unsigned int i) const
+{
+    const WorldFileEntity& e = entities_[i];
+    if (!e.color_valid)
+        return Color();
+
+    return Color(e.color[2], e.color[1], e.color[0], e.thickness);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldFileView::toWorldModel(WorldModel2D& wm) const
+{
+    std::vector<Model2DConstPtr> models(numShapes());
+    for(unsigned int i = 0; i < numShapes(); ++i)
+    {
+        const WorldFileShape& s = shapes_[i];
+
+        Model2D* model = new Model2D;
+        model->contours.resize(s.num_contours);
+
+        for(unsigned int j = 0; j < s.num_contours; ++j)
+        {
+            unsigned int num_points;
+            const double* p = contourPoints(s.first_contour + j, num_points);
+
+            std::vector<geo::Vec2>& c_points = model->contours[j].points;
+            c_points.resize(num_points);
+            for(unsigned int k = 0; k < num_points; ++k)
+                c_points[k] = geo::Vec2(p[2 * k], p[2 * k + 1]);
+        }
+
+        models[i].reset(model);
+    }
+
+    int i_first = wm.entities().size();
+    wm.reserve(i_first + numEntities());
+
+    for(unsigned int i = 0; i < numEntities(); ++i)
+        wm.addEntity(models[entities_[i].shape], pose(i), color(i));
+
+    // All world poses are known, so the tree can be restored in any order
+    for(unsigned int i = 0; i < numEntities(); ++i)
+    {
+        if (entities_[i].parent >= 0)
+            wm.setParent(i_first + i, i_first + entities_[i].parent);
+    }
+}
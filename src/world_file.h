@@ -0,0 +1,116 @@
+#ifndef _WORLD_FILE_H_
+#define _WORLD_FILE_H_
+
+#include "world_model.h"
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------------------------------------------
+//
+// Binary world format. All sections are flat arrays, 8-byte aligned, in native (little-endian) byte
+// order, directly after each other:
+//
+//     WorldFileHeader
+//     WorldFileEntity[num_entities]
+//     WorldFileShape[num_shapes]
+//     uint64_t contour_offsets[num_contours + 1]     (index of the first point of each contour)
+//     double points[2 * num_points]                  (x0, y0, x1, y1, ...)
+//
+// Shapes that are shared between entities are stored once.
+//
+// ----------------------------------------------------------------------------------------------------
+
+static const uint32_t WORLD_FILE_VERSION = 1;
+
+struct WorldFileHeader
+{
+    char magic[4];                  // "WM2D"
+    uint32_t version;
+    uint32_t num_entities;
+    uint32_t num_shapes;
+    uint32_t num_contours;
+    uint32_t reserved;
+    uint64_t num_points;
+};
+
+struct WorldFileEntity
+{
+    double t[2];
+    double R[4];                    // row-major
+    int32_t parent;
+    uint32_t shape;
+    unsigned char color[3];         // b, g, r
+    unsigned char color_valid;
+    int32_t thickness;
+};
+
+struct WorldFileShape
+{
+    uint32_t first_contour;
+    uint32_t num_contours;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+bool writeWorldFile(const std::string& filename, const WorldModel2D& wm);
+
+// ----------------------------------------------------------------------------------------------------
+
+// Read-only view on a memory-mapped world file. Opening only maps the file and checks the header and
+// section sizes; nothing is copied until toWorldModel() is called.
+
+class WorldFileView
+{
+
+public:
+
+    WorldFileView();
+
+    ~WorldFileView();
+
+    bool open(const std::string& filename);
+
+    void close();
+
+    bool isOpen() const { return data_ != 0; }
+
+    unsigned int numEntities() const { return header_->num_entities; }
+
+    unsigned int numShapes() const { return header_->num_shapes; }
+
+    const WorldFileEntity& entity(unsigned int i) const { return entities_[i]; }
+
+    const WorldFileShape& shape(unsigned int i) const { return shapes_[i]; }
+
+    geo::Transform2 pose(unsigned int i) const;
+
+    Color color(unsigned int i) const;
+
+    // Points of contour c as x0, y0, x1, y1, ...
+    const double* contourPoints(unsigned int c, unsigned int& num_points) const
+    {
+        num_points = contour_offsets_[c + 1] - contour_offsets_[c];
+        return points_ + 2 * contour_offsets_[c];
+    }
+
+    // Creates one shared Model2D per shape, and restores the transform tree
+    void toWorldModel(WorldModel2D& wm) const;
+
+private:
+
+    void* data_;
+    std::size_t size_;
+
+    const WorldFileHeader* header_;
+    const WorldFileEntity* entities_;
+    const WorldFileShape* shapes_;
+    const uint64_t* contour_offsets_;
+    const double* points_;
+
+    // Non-copyable
+    WorldFileView(const WorldFileView&);
+    WorldFileView& operator=(const WorldFileView&);
+
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include "world_generator.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+// Small xorshift generator, so worlds do not depend on the rand() implementation of the platform
+class Random
+{
+
+public:
+
+    Random(unsigned int seed) : state_(seed * 2654435761u + 1)
+    {
+        if (state_ == 0)
+            state_ = 1;
+    }
+
+    uint32_t next()
+    {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+
+    double uniform(double min, double max)
+    {
+        return min + (max - min) * (next() / 4294967296.0);
+    }
+
+    // In [min, max]
+    int uniformInt(int min, int max)
+    {
+        return min + next() % (max - min + 1);
+    }
+
+private:
+
+    uint32_t state_;
+
+};
+
+const double WALL_THICKNESS = 0.1;
+
+const Color WALL_COLOR(0, 0, 0, 2);
+const Color FURNITURE_COLOR(100, 100, 100, 1);
+
+// ----------------------------------------------------------------------------------------------------
+
+void addWall(WorldModel2D& wm, double x1, double y1, double x2, double y2)
+{
+    wm.addEntity(createBox(geo::Vec2(x1, y1), geo::Vec2(x2, y2)), geo::Transform2::identity(), WALL_COLOR);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void generateOffice(const WorldGeneratorParameters& params, Random& rnd, WorldModel2D& wm)
+{
+    double x_min = -params.width / 2;
+    double x_max = params.width / 2;
+    double y_min = -params.height / 2;
+    double y_max = params.height / 2;
+
+    double corridor_width = 2;
+    double door_width = 0.9;
+    double t = WALL_THICKNESS;
+
+    Model2DConstPtr desk(new Model2D(createBox(1.4, 0.7)));
+    Model2DConstPtr chair = getCircle(0.25);
+
+    // Rooms on both sides of the corridor
+    for(int side = -1; side <= 1; side += 2)
+    {
+        double y_corridor = side * corridor_width / 2;
+        double y_wall = side > 0 ? y_max : y_min;
+
+        double x = x_min;
+        while(x < x_max - 1)
+        {
+            double room_width = rnd.uniform(3, 5);
+            double x_next = x + room_width;
+
+            // Do not leave a sliver at the end
+            if (x_next > x_max - 3)
+                x_next = x_max;
+
+            // Corridor wall with a door. Rooms too narrow for a door (only in narrow worlds) are left open
+            // to the corridor.
+            double x_door_min = x + t + 0.2;
+            double x_door_max = x_next - t - 0.2 - door_width;
+            if (x_door_max >= x_door_min)
+            {
+                double x_door = rnd.uniform(x_door_min, x_door_max);
+                addWall(wm, x, y_corridor, x_door, y_corridor + side * t);
+                addWall(wm, x_door + door_width, y_corridor, x_next, y_corridor + side * t);
+            }
+
+            // Wall to the next room
+            if (x_next < x_max)
+                addWall(wm, x_next - t / 2, y_corridor, x_next + t / 2, y_wall);
+
+            // Desks with chairs
+            double rx_min = x + t + 0.8;
+            double rx_max = x_next - t - 0.8;
+            double ry_min = std::min(y_corridor, y_wall) + t + 0.8;
+            double ry_max = std::max(y_corridor, y_wall) - t - 0.8;
+
+            if (rx_max > rx_min && ry_max > ry_min)
+            {
+                int num_desks = (int)(params.density * (x_next - x) * (y_wall - y_corridor) * side / 6 + 0.5);
+                for(int i = 0; i < num_desks; ++i)
+                {
+                    double dx = rnd.uniform(rx_min, rx_max);
+                    double dy = rnd.uniform(ry_min, ry_max);
+                    double a = rnd.uniformInt(0, 3) * M_PI / 2;
+                    geo::Transform2 pose = fromXYA(dx, dy, a);
+                    wm.addEntity(desk, pose, FURNITURE_COLOR);
+
+                    geo::Vec2 p_chair = pose * geo::Vec2(0, 0.6);
+                    wm.addEntity(chair, fromXYA(p_chair.x, p_chair.y, 0), FURNITURE_COLOR);
+                }
+            }
+
+            x = x_next;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void generateWarehouse(const WorldGeneratorParameters& params, Random& rnd, WorldModel2D& wm)
+{
+    double x_min = -params.width / 2;
+    double x_max = params.width / 2;
+    double y_min = -params.height / 2;
+    double y_max = params.height / 2;
+
+    double margin = 3;
+    double rack_depth = 1.2;
+    double aisle_width = 3.5 - 2 * std::max(0.0, std::min(1.0, params.density));
+    double cross_aisle_width = 3;
+    double section_length = 15;
+
+    Model2DConstPtr pillar(new Model2D(createBox(0.4, 0.4)));
+
+    for(double y = y_min + margin; y + rack_depth < y_max - margin; y += rack_depth + aisle_width)
+    {
+        for(double x = x_min + margin; x < x_max - margin; x += section_length + cross_aisle_width)
+        {
+            // Sections vary a bit in length, so not every aisle looks the same
+            double length = std::min(section_length - rnd.uniform(0, 2), x_max - margin - x);
+            if (length < 1)
+                break;
+
+            addWall(wm, x, y, x + length, y + rack_depth);
+
+            double x_pillar = x + section_length + cross_aisle_width / 2;
+            if (x_pillar < x_max - margin)
+                wm.addEntity(pillar, fromXYA(x_pillar, y + rack_depth / 2, 0), WALL_COLOR);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void generateClutter(const WorldGeneratorParameters& params, Random& rnd, WorldModel2D& wm)
+{
+    double margin = 0.5;
+    double x_min = -params.width / 2 + margin;
+    double x_max = params.width / 2 - margin;
+    double y_min = -params.height / 2 + margin;
+    double y_max = params.height / 2 - margin;
+
+    int num_objects = (int)(params.density * params.width * params.height * 0.5 + 0.5);
+
+    for(int i = 0; i < num_objects; ++i)
+    {
+        // Separate statements: the order in which function arguments are evaluated is unspecified
+        double x = rnd.uniform(x_min, x_max);
+        double y = rnd.uniform(y_min, y_max);
+        double a = rnd.uniform(-M_PI, M_PI);
+        geo::Transform2 pose = fromXYA(x, y, a);
+
+        int kind = rnd.uniformInt(0, 2);
+        if (kind == 0)
+        {
+            double w = rnd.uniform(0.2, 1.0);
+            double h = rnd.uniform(0.2, 1.0);
+            wm.addEntity(createBox(w, h), pose, FURNITURE_COLOR);
+        }
+        else if (kind == 1)
+        {
+            // Radii in steps of 5 cm, so circles are shared
+            wm.addEntity(getCircle(0.05 * rnd.uniformInt(2, 10)), pose, FURNITURE_COLOR);
+        }
+        else
+        {
+            // Star-shaped polygon, clockwise like the other obstacles
+            int num_corners = rnd.uniformInt(5, 8);
+
+            std::vector<double> angles(num_corners);
+            for(int j = 0; j < num_corners; ++j)
+                angles[j] = rnd.uniform(0, 2 * M_PI);
+            std::sort(angles.begin(), angles.end());
+
+            Model2D model;
+            Contour2D& c = model.addContour();
+            for(int j = num_corners - 1; j >= 0; --j)
+            {
+                double r = rnd.uniform(0.2, 0.6);
+                c.addPoint(cos(angles[j]) * r, sin(angles[j]) * r);
+            }
+
+            wm.addEntity(model, pose, FURNITURE_COLOR);
+        }
+    }
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void generateWorld(const WorldGeneratorParameters& params, WorldModel2D& wm)
+{
+    Random rnd(params.seed);
+
+    wm.addEntity(createBox(params.width, params.height, true), geo::Transform2::identity(), WALL_COLOR);
+
+    if (params.type == WORLD_OFFICE)
+        generateOffice(params, rnd, wm);
+    else if (params.type == WORLD_WAREHOUSE)
+        generateWarehouse(params, rnd, wm);
+    else
+        generateClutter(params, rnd, wm);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool parseWorldType(const std::string& name, WorldType& type)
+{
+    if (name == "office")
+        type = WORLD_OFFICE;
+    else if (name == "warehouse")
+        type = WORLD_WAREHOUSE;
+    else if (name == "clutter")
+        type = WORLD_CLUTTER;
+    else
+        return false;
+
+    return true;
+}
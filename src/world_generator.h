@@ -0,0 +1,47 @@
+#ifndef _WORLD_GENERATOR_H_
+#define _WORLD_GENERATOR_H_
+
+#include "world_model.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+enum WorldType
+{
+    // Offices on both sides of a corridor, with desks and chairs
+    WORLD_OFFICE,
+
+    // Rows of racks with cross aisles and pillars
+    WORLD_WAREHOUSE,
+
+    // One room with randomly placed boxes, circles and polygons
+    WORLD_CLUTTER
+};
+
+// Below this width or height the corridor and rooms of an office do not fit
+const double MIN_WORLD_SIZE = 4;
+
+struct WorldGeneratorParameters
+{
+    WorldGeneratorParameters() : type(WORLD_OFFICE), width(40), height(20), density(0.5), seed(1) {}
+
+    WorldType type;
+
+    // Outer size of the world (m), at least MIN_WORLD_SIZE; the world is centered around the origin
+    double width;
+    double height;
+
+    // Between 0 (empty) and 1 (as full as the world type allows)
+    double density;
+
+    // The same parameters and seed always give the same world, on any platform
+    unsigned int seed;
+};
+
+// Adds the generated entities to wm. The outer wall comes first (counter-clockwise, like a room);
+// all other entities are clockwise obstacles.
+void generateWorld(const WorldGeneratorParameters& params, WorldModel2D& wm);
+
+// "office", "warehouse" or "clutter"; returns false for other names
+bool parseWorldType(const std::string& name, WorldType& type);
+
+#endif
@@ -0,0 +1,382 @@
+#include "world_index.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+typedef WorldIndex::Edge Edge;
+
+// > 0 if c lies left of the line from a to b
+double orientation(const geo::Vec2& a, const geo::Vec2& b, const geo::Vec2& c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// For c on the line through a and b
+bool withinBounds(const geo::Vec2& a, const geo::Vec2& b, const geo::Vec2& c)
+{
+    return c.x >= std::min(a.x, b.x) && c.x <= std::max(a.x, b.x) && c.y >= std::min(a.y, b.y) && c.y <= std::max(a.y, b.y);
+}
+
+// Touching segments intersect as well
+bool segmentsIntersect(const Edge& e1, const Edge& e2)
+{
+    double d1 = orientation(e2.p1, e2.p2, e1.p1);
+    double d2 = orientation(e2.p1, e2.p2, e1.p2);
+    double d3 = orientation(e1.p1, e1.p2, e2.p1);
+    double d4 = orientation(e1.p1, e1.p2, e2.p2);
+
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0)))
+        return true;
+
+    return (d1 == 0 && withinBounds(e2.p1, e2.p2, e1.p1)) || (d2 == 0 && withinBounds(e2.p1, e2.p2, e1.p2))
+        || (d3 == 0 && withinBounds(e1.p1, e1.p2, e2.p1)) || (d4 == 0 && withinBounds(e1.p1, e1.p2, e2.p2));
+}
+
+// Winding number contribution of a closed edge for a ray from p along +x; counter-clockwise contours
+// around p sum up to +1, clockwise ones to -1
+int winding(const Edge& e, const geo::Vec2& p)
+{
+    if (!e.closed)
+        return 0;
+
+    if (e.p1.y <= p.y)
+    {
+        if (e.p2.y > p.y && orientation(e.p1, e.p2, p) > 0)
+            return 1;
+    }
+    else if (e.p2.y <= p.y && orientation(e.p1, e.p2, p) < 0)
+        return -1;
+
+    return 0;
+}
+
+// Edges cross, or a vertex of one set lies inside an obstacle contour of the other
+bool edgeSetsOverlap(const Edge* edges1, int n1, const Edge* edges2, int n2)
+{
+    for(int i = 0; i < n1; ++i)
+    {
+        int w = 0;
+        for(int j = 0; j < n2; ++j)
+        {
+            if (segmentsIntersect(edges1[i], edges2[j]))
+                return true;
+            w += winding(edges2[j], edges1[i].p1);
+        }
+
+        if (w < 0)
+            return true;
+    }
+
+    for(int j = 0; j < n2; ++j)
+    {
+        int w = 0;
+        for(int i = 0; i < n1; ++i)
+            w += winding(edges1[i], edges2[j].p1);
+
+        if (w < 0)
+            return true;
+    }
+
+    return false;
+}
+
+bool boxesOverlap(const geo::Vec2& min1, const geo::Vec2& max1, const geo::Vec2& min2, const geo::Vec2& max2)
+{
+    return min1.x <= max2.x && min2.x <= max1.x && min1.y <= max2.y && min2.y <= max1.y;
+}
+
+// Inside one of the clockwise contours of the model (in model coordinates)
+bool insideObstacle(const Model2D& model, const geo::Vec2& p)
+{
+    int w = 0;
+    for(unsigned int i = 0; i < model.contours.size(); ++i)
+    {
+        const Contour2D& c = model.contours[i];
+        if (c.points.size() < 3 || c.signedArea() > 0)
+            continue;
+
+        for(unsigned int j = 0; j < c.points.size(); ++j)
+        {
+            Edge e;
+            e.p1 = c.points[j];
+            e.p2 = c.points[(j + 1) % c.points.size()];
+            e.closed = true;
+            w += winding(e, p);
+        }
+    }
+
+    return w < 0;
+}
+
+void addModelEdges(const Model2D& model, const geo::Transform2& pose, std::vector<Edge>& edges,
+                   geo::Vec2& p_min, geo::Vec2& p_max, bool& has_rooms)
+{
+    for(unsigned int i = 0; i < model.contours.size(); ++i)
+    {
+        const Contour2D& c = model.contours[i];
+        if (c.points.size() < 2)
+            continue;
+
+        // Counter-clockwise contours inside an obstacle of the same entity are holes (e.g. in traced maps),
+        // the others are rooms
+        bool closed = c.points.size() > 2;
+        if (closed && !has_rooms && c.signedArea() > 0 && !insideObstacle(model, c.points[0]))
+            has_rooms = true;
+
+        unsigned int num_edges = closed ? c.points.size() : 1;
+        for(unsigned int j = 0; j < num_edges; ++j)
+        {
+            Edge e;
+            e.p1 = pose * c.points[j];
+            e.p2 = pose * c.points[(j + 1) % c.points.size()];
+            e.closed = closed;
+            edges.push_back(e);
+
+            p_min.x = std::min(p_min.x, e.p1.x);
+            p_min.y = std::min(p_min.y, e.p1.y);
+            p_max.x = std::max(p_max.x, e.p1.x);
+            p_max.y = std::max(p_max.y, e.p1.y);
+        }
+
+        // Lines have their second point only in p2
+        if (!closed)
+        {
+            const geo::Vec2& p = edges.back().p2;
+            p_min.x = std::min(p_min.x, p.x);
+            p_min.y = std::min(p_min.y, p.y);
+            p_max.x = std::max(p_max.x, p.x);
+            p_max.y = std::max(p_max.y, p.y);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+class IsFree : public cv::ParallelLoopBody
+{
+
+public:
+
+    IsFree(const WorldIndex& index, const std::vector<geo::Vec2>& points, double clearance, std::vector<unsigned char>& free)
+        : index_(index), points_(points), clearance_(clearance), free_(free) {}
+
+    void operator()(const cv::Range& r) const
+    {
+        for(int i = r.start; i < r.end; ++i)
+            free_[i] = index_.isFree(points_[i], clearance_);
+    }
+
+private:
+
+    const WorldIndex& index_;
+    const std::vector<geo::Vec2>& points_;
+    double clearance_;
+    std::vector<unsigned char>& free_;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+class ObstacleDistance : public cv::ParallelLoopBody
+{
+
+public:
+
+    ObstacleDistance(const WorldIndex& index, const std::vector<geo::Vec2>& points, double max_dist, std::vector<double>& distances)
+        : index_(index), points_(points), max_dist_(max_dist), distances_(distances) {}
+
+    void operator()(const cv::Range& r) const
+    {
+        for(int i = r.start; i < r.end; ++i)
+            distances_[i] = index_.obstacleDistance(points_[i], max_dist_);
+    }
+
+private:
+
+    const WorldIndex& index_;
+    const std::vector<geo::Vec2>& points_;
+    double max_dist_;
+    std::vector<double>& distances_;
+};
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+WorldIndex::WorldIndex(double cell_size) : grid_(cell_size), has_rooms_(false), band_height_(cell_size), band_y0_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldIndex::build(const WorldModel2D& wm)
+{
+    grid_.clear();
+    grid_.addWorldModel(wm);
+    grid_.build();
+
+    has_rooms_ = false;
+    edges_.clear();
+    entity_offsets_.assign(1, 0);
+    entity_min_.resize(wm.entities().size());
+    entity_max_.resize(wm.entities().size());
+
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
+    {
+        const Entity2D& e = wm.entities()[i];
+
+        entity_min_[i] = geo::Vec2(1e9, 1e9);
+        entity_max_[i] = geo::Vec2(-1e9, -1e9);
+        addModelEdges(*e.shape, e.pose(), edges_, entity_min_[i], entity_max_[i], has_rooms_);
+
+        entity_offsets_.push_back(edges_.size());
+    }
+
+    // Bands over the closed edges
+    band_offsets_.clear();
+    band_edges_.clear();
+
+    double y_min = 1e9;
+    double y_max = -1e9;
+    for(unsigned int i = 0; i < edges_.size(); ++i)
+    {
+        if (!edges_[i].closed)
+            continue;
+        y_min = std::min(y_min, std::min(edges_[i].p1.y, edges_[i].p2.y));
+        y_max = std::max(y_max, std::max(edges_[i].p1.y, edges_[i].p2.y));
+    }
+
+    if (y_max < y_min)
+        return;
+
+    band_y0_ = y_min;
+    int num_bands = (y_max - y_min) / band_height_ + 1;
+
+    // First pass counts, second pass fills
+    std::vector<int> counts(num_bands + 1, 0);
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        for(unsigned int i = 0; i < edges_.size(); ++i)
+        {
+            const Edge& e = edges_[i];
+            if (!e.closed)
+                continue;
+
+            int b_min = (std::min(e.p1.y, e.p2.y) - band_y0_) / band_height_;
+            int b_max = (std::max(e.p1.y, e.p2.y) - band_y0_) / band_height_;
+
+            for(int b = b_min; b <= b_max; ++b)
+            {
+                if (pass == 0)
+                    ++counts[b];
+                else
+                    band_edges_[--counts[b]] = i;
+            }
+        }
+
+        if (pass == 0)
+        {
+            for(unsigned int k = 1; k < counts.size(); ++k)
+                counts[k] += counts[k - 1];
+            band_edges_.resize(counts.back());
+        }
+    }
+
+    band_offsets_ = counts;
+    band_offsets_.back() = band_edges_.size();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int WorldIndex::winding(const geo::Vec2& p) const
+{
+    if (band_offsets_.empty())
+        return 0;
+
+    int b = floor((p.y - band_y0_) / band_height_);
+    if (b < 0 || b + 1 >= (int)band_offsets_.size())
+        return 0;
+
+    int w = 0;
+    for(int j = band_offsets_[b]; j < band_offsets_[b + 1]; ++j)
+        w += ::winding(edges_[band_edges_[j]], p);
+
+    return w;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool WorldIndex::isFree(const geo::Vec2& p, double clearance) const
+{
+    int w = winding(p);
+    if (has_rooms_ ? w <= 0 : w < 0)
+        return false;
+
+    geo::Vec2 closest;
+    return clearance <= 0 || grid_.findNearest(p, clearance, closest) < 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double WorldIndex::obstacleDistance(const geo::Vec2& p, double max_dist) const
+{
+    geo::Vec2 closest;
+    if (grid_.findNearest(p, max_dist, closest) < 0)
+        return max_dist;
+
+    return (closest - p).length();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldIndex::isFree(const std::vector<geo::Vec2>& points, double clearance, std::vector<unsigned char>& free) const
+{
+    free.resize(points.size());
+    cv::parallel_for_(cv::Range(0, points.size()), IsFree(*this, points, clearance, free));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldIndex::obstacleDistances(const std::vector<geo::Vec2>& points, double max_dist, std::vector<double>& distances) const
+{
+    distances.resize(points.size());
+    cv::parallel_for_(cv::Range(0, points.size()), ObstacleDistance(*this, points, max_dist, distances));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool WorldIndex::overlaps(int i1, int i2) const
+{
+    if (!boxesOverlap(entity_min_[i1], entity_max_[i1], entity_min_[i2], entity_max_[i2]))
+        return false;
+
+    int o1 = entity_offsets_[i1];
+    int o2 = entity_offsets_[i2];
+
+    return edgeSetsOverlap(&edges_[0] + o1, entity_offsets_[i1 + 1] - o1, &edges_[0] + o2, entity_offsets_[i2 + 1] - o2);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldIndex::findOverlapping(const Model2D& model, const geo::Transform2& pose, std::vector<int>& entities) const
+{
+    std::vector<Edge> edges;
+    geo::Vec2 p_min(1e9, 1e9);
+    geo::Vec2 p_max(-1e9, -1e9);
+    bool has_rooms;
+    addModelEdges(model, pose, edges, p_min, p_max, has_rooms);
+
+    if (edges.empty())
+        return;
+
+    for(unsigned int i = 0; i < entity_min_.size(); ++i)
+    {
+        if (!boxesOverlap(p_min, p_max, entity_min_[i], entity_max_[i]))
+            continue;
+
+        int o = entity_offsets_[i];
+        if (edgeSetsOverlap(&edges[0], edges.size(), &edges_[0] + o, entity_offsets_[i + 1] - o))
+            entities.push_back(i);
+    }
+}
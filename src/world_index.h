@@ -0,0 +1,80 @@
+#ifndef _WORLD_INDEX_H_
+#define _WORLD_INDEX_H_
+
+#include "scan_matcher.h"
+#include "world_model.h"
+
+// ----------------------------------------------------------------------------------------------------
+
+// Geometric queries on a world model. Contours are interpreted by their winding, like everywhere else:
+// clockwise contours are obstacles, counter-clockwise ones are rooms, or holes if they lie inside an
+// obstacle contour of the same entity (like traced maps). If the world has rooms, a point is only free if
+// it lies inside one; otherwise everything outside the obstacles (or inside their holes) is free.
+// Two-point contours (lines) count for distances and overlaps, not for inside / outside.
+//
+// The index is a snapshot: call build() again after the world model changed.
+
+class WorldIndex
+{
+
+public:
+
+    WorldIndex(double cell_size = 0.25);
+
+    void build(const WorldModel2D& wm);
+
+    // Not inside an obstacle, and at least 'clearance' (m) from the nearest edge
+    bool isFree(const geo::Vec2& p, double clearance = 0) const;
+
+    // Distance to the nearest edge, or max_dist if there is none within max_dist
+    double obstacleDistance(const geo::Vec2& p, double max_dist) const;
+
+    // Batched versions, computed in parallel
+    void isFree(const std::vector<geo::Vec2>& points, double clearance, std::vector<unsigned char>& free) const;
+
+    void obstacleDistances(const std::vector<geo::Vec2>& points, double max_dist, std::vector<double>& distances) const;
+
+    // Entities overlap if their edges cross or one lies inside an obstacle contour of the other (being
+    // inside a room does not count)
+    bool overlaps(int i1, int i2) const;
+
+    // Indices of all entities a shape at the given pose would overlap with, e.g. to place new entities
+    void findOverlapping(const Model2D& model, const geo::Transform2& pose, std::vector<int>& entities) const;
+
+    const SegmentGrid& segmentGrid() const { return grid_; }
+
+    struct Edge
+    {
+        geo::Vec2 p1;
+        geo::Vec2 p2;
+        bool closed;    // part of a contour with an area
+    };
+
+private:
+
+    // Nearest-edge lookups
+    SegmentGrid grid_;
+
+    bool has_rooms_;
+
+    // Edges in world coordinates, grouped per entity: edges of entity i are
+    // edges_[entity_offsets_[i]] ... edges_[entity_offsets_[i + 1] - 1]
+    std::vector<Edge> edges_;
+    std::vector<int> entity_offsets_;
+
+    // Bounding box per entity
+    std::vector<geo::Vec2> entity_min_;
+    std::vector<geo::Vec2> entity_max_;
+
+    // Horizontal bands of cell_size high, with the closed edges that overlap them (in compressed row
+    // layout, like SegmentGrid), for the winding number of a point
+    double band_height_;
+    double band_y0_;
+    std::vector<int> band_offsets_;
+    std::vector<int> band_edges_;
+
+    int winding(const geo::Vec2& p) const;
+
+};
+
+#endif
@@ -4,6 +4,212 @@
 
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <algorithm>
+#include <map>
+
+// ----------------------------------------------------------------------------------------------------
+
+Entity2D::Entity2D() : parent_(-1), revision_(0), dirty_(false)
+{
+    static Model2DConstPtr empty(new Model2D);
+    shape = empty;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldModel2D::addEntity(const Entity2D& e)
+{
+    changeStructure();
+    entities_.push_back(Entity2D(e.shape, e.pose(), e.color));
+    entities_.back().revision_ = revision_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldModel2D::clear()
+{
+    entities_.clear();
+    dirty_.clear();
+    changeStructure();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldModel2D::truncate(unsigned int n)
+{
+    if (n >= entities_.size())
+        return;
+
+    updatePoses();
+    changeStructure();
+
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        Entity2D& e = entities_[i];
+        if (e.parent_ >= (int)n)
+        {
+            e.parent_ = -1;
+            e.local_pose_ = e.pose_;
+            e.revision_ = revision_;
+        }
+
+        unsigned int k = 0;
+        for(unsigned int j = 0; j < e.children_.size(); ++j)
+        {
+            if (e.children_[j] < (int)n)
+                e.children_[k++] = e.children_[j];
+        }
+        e.children_.resize(k);
+    }
+
+    entities_.resize(n);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool WorldModel2D::setParent(int i, int i_parent)
+{
+    Entity2D& e = entities_[i];
+    if (e.parent_ == i_parent)
+        return true;
+
+    // Do not create cycles
+    for(int j = i_parent; j >= 0; j = entities_[j].parent_)
+    {
+        if (j == i)
+            return false;
+    }
+
+    updatePoses();
+
+    if (e.parent_ >= 0)
+    {
+        std::vector<int>& siblings = entities_[e.parent_].children_;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), i));
+    }
+
+    e.parent_ = i_parent;
+
+    if (i_parent >= 0)
+    {
+        entities_[i_parent].children_.push_back(i);
+        e.local_pose_ = entities_[i_parent].pose_.inverse() * e.pose_;
+    }
+    else
+        e.local_pose_ = e.pose_;
+
+    changeStructure();
+    e.revision_ = revision_;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldModel2D::setPose(int i, const geo::Transform2& pose)
+{
+    Entity2D& e = entities_[i];
+
+    if (e.parent_ >= 0)
+    {
+        updatePoses();
+        e.local_pose_ = entities_[e.parent_].pose_.inverse() * pose;
+    }
+    else
+        e.local_pose_ = pose;
+
+    markDirty(i);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldModel2D::setLocalPose(int i, const geo::Transform2& local_pose)
+{
+    entities_[i].local_pose_ = local_pose;
+    markDirty(i);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldModel2D::markDirty(int i)
+{
+    Entity2D& e = entities_[i];
+    e.revision_ = ++revision_;
+
+    if (e.dirty_)
+        return;
+
+    e.dirty_ = true;
+    dirty_.push_back(i);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldModel2D::changeStructure()
+{
+    ++revision_;
+    ++structure_revision_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldModel2D::updatePoses() const
+{
+    if (dirty_.empty())
+        return;
+
+    // Only start at dirty entities without dirty ancestors: the others are covered by their subtrees
+    std::vector<int> stack;
+    for(unsigned int k = 0; k < dirty_.size(); ++k)
+    {
+        int i = dirty_[k];
+        if (i >= (int)entities_.size() || !entities_[i].dirty_)
+            continue;
+
+        bool covered = false;
+        for(int j = entities_[i].parent_; j >= 0 && !covered; j = entities_[j].parent_)
+            covered = entities_[j].dirty_;
+
+        if (!covered)
+            stack.push_back(i);
+    }
+
+    dirty_.clear();
+
+    // Depth-first, so parents are always done before their children
+    while(!stack.empty())
+    {
+        int i = stack.back();
+        stack.pop_back();
+
+        const Entity2D& e = entities_[i];
+        if (e.parent_ >= 0)
+            e.pose_ = entities_[e.parent_].pose_ * e.local_pose_;
+        else
+            e.pose_ = e.local_pose_;
+
+        e.dirty_ = false;
+        stack.insert(stack.end(), e.children_.begin(), e.children_.end());
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+WorldModel2D WorldModel2D::createTransformed(const geo::Transform2& t) const
+{
+    updatePoses();
+
+    WorldModel2D wm_t = *this;
+    for(unsigned int i = 0; i < wm_t.entities_.size(); ++i)
+    {
+        Entity2D& e = wm_t.entities_[i];
+        e.pose_ = t * e.pose_;
+        if (e.parent_ < 0)
+            e.local_pose_ = e.pose_;
+    }
+
+    return wm_t;
+}
+
 // ----------------------------------------------------------------------------------------------------
 
 Model2D createBox(double width, double height, bool inside_out)
@@ -73,6 +279,36 @@ Model2D createCircle(double radius, int num_corners)
 
 // ----------------------------------------------------------------------------------------------------
 
+Model2DConstPtr getCircle(double radius, int num_corners)
+{
+    static std::map<std::pair<double, int>, Model2DConstPtr> cache;
+
+    Model2DConstPtr& m = cache[std::make_pair(radius, num_corners)];
+    if (!m)
+        m.reset(new Model2D(createCircle(radius, num_corners)));
+    return m;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+Model2DConstPtr getPoseMarker(double radius, double length)
+{
+    static std::map<std::pair<double, double>, Model2DConstPtr> cache;
+
+    Model2DConstPtr& m = cache[std::make_pair(radius, length)];
+    if (!m)
+    {
+        Model2D* model = new Model2D(createCircle(radius));
+        Contour2D& c = model->addContour();
+        c.addPoint(0, 0);
+        c.addPoint(length, 0);
+        m.reset(model);
+    }
+    return m;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 geo::Transform2 fromXYA(double x, double y, double a)
 {
     geo::Transform2 t;
@@ -86,32 +322,106 @@ geo::Transform2 fromXYADegrees(double x, double y, double a_degrees)
     return fromXYA(x, y, a_degrees / 180 * M_PI);
 }
 
+double getRotation(const geo::Transform2& t)
+{
+    geo::Vec2 x_axis = t.R * geo::Vec2(1, 0);
+    return atan2(x_axis.y, x_axis.x);
+}
+
 // ----------------------------------------------------------------------------------------------------
 
 void drawModel(Canvas& canvas, const Model2D& m, const geo::Transform2& m_pose, const Color& color)
 {
+    ContourBatch batch(canvas);
+    batch.add(m, m_pose, color);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ContourBatch::add(const Model2D& m, const geo::Transform2& m_pose, const Color& color)
+{
+    if (!points_.empty() && (color.color != color_.color || color.thickness != color_.thickness))
+        flush();
+
+    color_ = color;
+
+    // Contours this far outside the image can not touch it (thick lines are drawn with round caps)
+    int margin = color.thickness + 1;
+    int x_max = canvas_.image.cols + margin;
+    int y_max = canvas_.image.rows + margin;
+
     for(std::vector<Contour2D>::const_iterator it = m.contours.begin(); it != m.contours.end(); ++it)
     {
         const Contour2D& c = *it;
+        if (c.points.empty())
+            continue;
+
+        unsigned int i_first = points_.size();
+        points_.resize(i_first + c.points.size());
 
+        cv::Point p_min(x_max, y_max);
+        cv::Point p_max(-margin, -margin);
         for(unsigned int j = 0; j < c.points.size(); ++j)
         {
-            cv::Point p1_img = canvas.worldToImage(m_pose * c.points[j]);
-            cv::Point p2_img = canvas.worldToImage(m_pose * c.points[(j + 1) % c.points.size()]);
+            cv::Point p = canvas_.worldToImage(m_pose * c.points[j]);
+            points_[i_first + j] = p;
 
-            cv::line(canvas.image, p1_img, p2_img, color.color, color.thickness, CV_AA);
+            p_min.x = std::min(p_min.x, p.x);
+            p_min.y = std::min(p_min.y, p.y);
+            p_max.x = std::max(p_max.x, p.x);
+            p_max.y = std::max(p_max.y, p.y);
         }
+
+        if (p_max.x < -margin || p_max.y < -margin || p_min.x > x_max || p_min.y > y_max)
+        {
+            points_.resize(i_first);
+        }
+        else
+        {
+            counts_.push_back(c.points.size());
+            rect_ = rect_ | cv::Rect(p_min.x - margin, p_min.y - margin, p_max.x - p_min.x + 2 * margin + 1, p_max.y - p_min.y + 2 * margin + 1);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ContourBatch::flush()
+{
+    if (counts_.empty())
+    {
+        points_.clear();
+        return;
     }
+
+    contours_.resize(counts_.size());
+    const cv::Point* p = &points_[0];
+    for(unsigned int i = 0; i < counts_.size(); ++i)
+    {
+        contours_[i] = p;
+        p += counts_[i];
+    }
+
+    canvas_.modify(rect_);
+    cv::polylines(canvas_.image, &contours_[0], &counts_[0], counts_.size(), true, canvas_.ink(color_.color), color_.thickness,
+                  canvas_.lineType());
+
+    points_.clear();
+    counts_.clear();
+    rect_ = cv::Rect();
 }
 
 // ----------------------------------------------------------------------------------------------------
 
 void drawWorld(Canvas& canvas, const WorldModel2D& wm)
 {
-    for(unsigned int i = 0; i < wm.entities.size(); ++i)
+    wm.updatePoses();
+
+    ContourBatch batch(canvas);
+    for(unsigned int i = 0; i < wm.entities().size(); ++i)
     {
-        const Entity2D& e = wm.entities[i];
-        drawModel(canvas, e.shape, e.pose, e.color);
+        const Entity2D& e = wm.entities()[i];
+        batch.add(*e.shape, e.pose(), e.color);
     }
 }
 
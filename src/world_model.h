@@ -3,6 +3,8 @@
 
 #include "canvas.h"
 
+#include <boost/shared_ptr.hpp>
+
 // ----------------------------------------------------------------------------------------------------
 
 struct Contour2D
@@ -10,6 +12,19 @@ struct Contour2D
     std::vector<geo::Vec2> points;
 
     void addPoint(double x, double y) { points.push_back(geo::Vec2(x, y)); }
+
+    // Positive for counter-clockwise contours (like createBox(..., true)), negative for clockwise ones
+    double signedArea() const
+    {
+        double a = 0;
+        for(unsigned int i = 0; i < points.size(); ++i)
+        {
+            const geo::Vec2& p1 = points[i];
+            const geo::Vec2& p2 = points[(i + 1) % points.size()];
+            a += p1.x * p2.y - p2.x * p1.y;
+        }
+        return 0.5 * a;
+    }
 };
 
 // ----------------------------------------------------------------------------------------------------
@@ -24,43 +39,130 @@ struct Model2D
     }
 };
 
+// Shapes are immutable once created and shared between entities (and between copies of a world model)
+typedef boost::shared_ptr<const Model2D> Model2DConstPtr;
+
 // ----------------------------------------------------------------------------------------------------
 
 struct Entity2D
 {
-    Entity2D() {}
+    Entity2D();
     Entity2D(const Model2D& shape_, const geo::Transform2& pose_, const Color& color_)
-        : shape(shape_), pose(pose_), color(color_) {}
+        : shape(new Model2D(shape_)), color(color_), pose_(pose_), parent_(-1), local_pose_(pose_), revision_(0), dirty_(false) {}
+    Entity2D(const Model2DConstPtr& shape_, const geo::Transform2& pose_, const Color& color_)
+        : shape(shape_), color(color_), pose_(pose_), parent_(-1), local_pose_(pose_), revision_(0), dirty_(false) {}
+
+    Model2DConstPtr shape;
 
-    Model2D shape;
-    geo::Transform2 pose;
     Color color;
+
+    // World pose. For entities with a parent this is derived from the local pose.
+    const geo::Transform2& pose() const { return pose_; }
+
+    // Transform tree. Parent is -1 for roots, for which the local pose is the world pose.
+    int parent() const { return parent_; }
+    const geo::Transform2& localPose() const { return local_pose_; }
+    const std::vector<int>& children() const { return children_; }
+
+    // Revision of the world model at which the local pose or the parent of this entity last changed
+    unsigned long revision() const { return revision_; }
+
+private:
+
+    friend struct WorldModel2D;
+
+    // Poses and tree links are only changed through the world model, so they can not get out of sync
+    mutable geo::Transform2 pose_;
+    int parent_;
+    geo::Transform2 local_pose_;
+    std::vector<int> children_;
+
+    unsigned long revision_;
+
+    // Set if the world poses of this entity and its subtree must be recomputed
+    mutable bool dirty_;
 };
 
 // ----------------------------------------------------------------------------------------------------
 
+// Entities can be attached to each other: the world pose of a child is the world pose of its parent
+// times its local pose. Poses changed through setPose / setLocalPose only mark the subtree dirty; world
+// poses are recomputed, parents before children, by updatePoses(), which entities() calls first (so
+// reading entities is not thread-safe while poses are being changed).
 
 struct WorldModel2D
 {
-    std::vector<Entity2D> entities;
+    WorldModel2D() : revision_(0), structure_revision_(0) {}
 
-    void addEntity(const Model2D& m, const geo::Transform2& t, const Color& color = Color(0, 0, 0, 2))
+    const std::vector<Entity2D>& entities() const
     {
-        entities.push_back(Entity2D(m, t, color));
+        updatePoses();
+        return entities_;
     }
 
-    WorldModel2D createTransformed(const geo::Transform2& t)
+    void addEntity(const Model2D& m, const geo::Transform2& t, const Color& color = Color(0, 0, 0, 2))
     {
-        WorldModel2D wm_t = *this;
-        for(unsigned int i = 0; i < wm_t.entities.size(); ++i)
-        {
-            Entity2D& e = wm_t.entities[i];
-            e.pose = t * e.pose;
-        }
+        addEntity(Entity2D(m, t, color));
+    }
 
-        return wm_t;
+    void addEntity(const Model2DConstPtr& m, const geo::Transform2& t, const Color& color = Color(0, 0, 0, 2))
+    {
+        addEntity(Entity2D(m, t, color));
     }
 
+    // Adds the entity as a root at its world pose. Its tree links refer to the world it came from, so they
+    // are not copied.
+    void addEntity(const Entity2D& e);
+
+    void reserve(unsigned int n) { entities_.reserve(n); }
+
+    void clear();
+
+    // Removes entity n and all entities after it. Entities attached to a removed entity become roots,
+    // keeping their world pose.
+    void truncate(unsigned int n);
+
+    void setShape(int i, const Model2DConstPtr& shape) { entities_[i].shape = shape; }
+
+    void setColor(int i, const Color& color) { entities_[i].color = color; }
+
+    // Attaches entity i to i_parent (-1 detaches it), keeping its current world pose. Returns false
+    // (and changes nothing) if i_parent is part of the subtree of i.
+    bool setParent(int i, int i_parent);
+
+    // Sets the world pose of entity i; its subtree moves along
+    void setPose(int i, const geo::Transform2& pose);
+
+    // Sets the pose of entity i relative to its parent (the world pose for roots)
+    void setLocalPose(int i, const geo::Transform2& local_pose);
+
+    void updatePoses() const;
+
+    // Incremented whenever entities are added or removed, or the tree structure or a pose changes
+    unsigned long revision() const { return revision_; }
+
+    // Incremented whenever entities are added or removed, or the tree structure changes. Pose changes only
+    // stamp the entity that was changed (see Entity2D::revision()).
+    unsigned long structureRevision() const { return structure_revision_; }
+
+    // Only copies the entities: the shapes are shared with this world model
+    WorldModel2D createTransformed(const geo::Transform2& t) const;
+
+private:
+
+    std::vector<Entity2D> entities_;
+
+    // Entities marked dirty since the last updatePoses()
+    mutable std::vector<int> dirty_;
+
+    unsigned long revision_;
+
+    unsigned long structure_revision_;
+
+    void markDirty(int i);
+
+    void changeStructure();
+
 };
 
 // ----------------------------------------------------------------------------------------------------
@@ -75,16 +177,58 @@ void createCircleContour(double radius, Contour2D& c, int num_corners = 20);
 
 Model2D createCircle(double radius, int num_corners = 20);
 
+// Interned versions of the shapes above: the same parameters give the same shared instance. Not
+// thread-safe; only call these from the thread that builds the world model or draws.
+Model2DConstPtr getCircle(double radius, int num_corners = 20);
+
+// Circle with a line from its center along +x (used to draw particles and sensor poses)
+Model2DConstPtr getPoseMarker(double radius = 0.1, double length = 0.2);
+
 // ----------------------------------------------------------------------------------------------------
 
 geo::Transform2 fromXYA(double x, double y, double a);
 
 geo::Transform2 fromXYADegrees(double x, double y, double a_degrees);
 
+double getRotation(const geo::Transform2& t);
+
 // ----------------------------------------------------------------------------------------------------
 
 void drawModel(Canvas& canvas, const Model2D& m, const geo::Transform2& m_pose, const Color& color);
 
+// Transforms contours to image coordinates once and draws them with as few cv::polylines calls as
+// possible: consecutive contours of the same color are drawn together. Contours of which the bounding box
+// is outside the image are skipped. Everything is drawn at the latest on destruction.
+class ContourBatch
+{
+
+public:
+
+    ContourBatch(Canvas& canvas) : canvas_(canvas) {}
+
+    ~ContourBatch() { flush(); }
+
+    void add(const Model2D& m, const geo::Transform2& m_pose, const Color& color);
+
+    void flush();
+
+private:
+
+    Canvas& canvas_;
+
+    Color color_;
+
+    std::vector<cv::Point> points_;
+    std::vector<int> counts_;
+
+    // Area the contours (with their line thickness) cover
+    cv::Rect rect_;
+
+    // Pointers into points_, only valid during flush()
+    std::vector<const cv::Point*> contours_;
+
+};
+
 // ----------------------------------------------------------------------------------------------------
 
 void drawWorld(Canvas& canvas, const WorldModel2D& wm);
@@ -0,0 +1,113 @@
+#include "canvas.h"
+#include "world_model.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <gtest/gtest.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+void drawBox(Canvas& canvas, const cv::Rect& rect, const cv::Scalar& color)
+{
+    canvas.modify(rect);
+    cv::rectangle(canvas.image, rect, canvas.ink(color), CV_FILLED);
+}
+
+bool sameImage(const cv::Mat& image1, const cv::Mat& image2)
+{
+    return cv::norm(image1, image2, cv::NORM_INF) == 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(CanvasJournal, RestoreTwice)
+{
+    Canvas canvas(320, 240, cv::Scalar(255, 255, 255));
+    drawBox(canvas, cv::Rect(10, 10, 50, 40), cv::Scalar(0, 0, 255));
+    cv::Mat original = canvas.image.clone();
+
+    CanvasSnapshot snapshot = canvas.snapshot(32);
+
+    drawBox(canvas, cv::Rect(30, 20, 100, 100), cv::Scalar(0, 150, 0));
+    drawModel(canvas, createCircle(0.5), fromXYA(0.3, 0.2, 0), Color(255, 0, 0, 2));
+    canvas.restore(snapshot);
+    EXPECT_TRUE(sameImage(original, canvas.image));
+
+    // Other tiles than the first time
+    drawBox(canvas, cv::Rect(200, 150, 90, 60), cv::Scalar(0, 150, 0));
+    canvas.restore(snapshot);
+    EXPECT_TRUE(sameImage(original, canvas.image));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(CanvasJournal, TwoSnapshots)
+{
+    Canvas canvas(320, 240, cv::Scalar(255, 255, 255));
+    cv::Mat image1 = canvas.image.clone();
+    CanvasSnapshot snapshot1 = canvas.snapshot(32);
+
+    drawBox(canvas, cv::Rect(40, 40, 100, 80), cv::Scalar(0, 0, 255));
+    cv::Mat image2 = canvas.image.clone();
+    CanvasSnapshot snapshot2 = canvas.snapshot(32);
+
+    drawBox(canvas, cv::Rect(100, 60, 120, 120), cv::Scalar(0, 150, 0));
+
+    // Restoring the first snapshot changes pixels the second one has to restore
+    canvas.restore(snapshot1);
+    EXPECT_TRUE(sameImage(image1, canvas.image));
+
+    canvas.restore(snapshot2);
+    EXPECT_TRUE(sameImage(image2, canvas.image));
+
+    canvas.restore(snapshot1);
+    EXPECT_TRUE(sameImage(image1, canvas.image));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(CanvasJournal, SubCanvas)
+{
+    Canvas canvas(320, 240, cv::Scalar(255, 255, 255));
+    drawBox(canvas, cv::Rect(150, 20, 120, 120), cv::Scalar(0, 0, 255));
+    cv::Mat original = canvas.image.clone();
+
+    CanvasSnapshot snapshot = canvas.snapshot(32);
+
+    // Draws the sub-canvas border into the canvas, and the circle into the sub-canvas
+    Canvas sub = canvas.createSubCanvas(0.5, 0.1, 0.3, 0.3);
+    sub.pixels_per_meter = 40;
+    drawModel(sub, createCircle(0.5), fromXYA(0, 0, 0), Color(255, 0, 0, 2));
+
+    canvas.restore(snapshot);
+    EXPECT_TRUE(sameImage(original, canvas.image));
+
+    // A snapshot taken from the sub-canvas covers the whole canvas
+    CanvasSnapshot sub_snapshot = sub.snapshot(32);
+    drawBox(canvas, cv::Rect(0, 0, 320, 240), cv::Scalar(0, 150, 0));
+    sub.restore(sub_snapshot);
+    EXPECT_TRUE(sameImage(original, canvas.image));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(CanvasJournal, DirectWriteIsCaught)
+{
+    Canvas canvas(320, 240, cv::Scalar(255, 255, 255));
+    CanvasSnapshot snapshot = canvas.snapshot(32);
+
+    cv::rectangle(canvas.image, cv::Rect(10, 10, 20, 20), cv::Scalar(0, 0, 255), CV_FILLED);
+
+    EXPECT_THROW(canvas.restore(snapshot), cv::Exception);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    // Every test also checks that nothing changes pixels without announcing it
+    Canvas::checkSnapshots();
+
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
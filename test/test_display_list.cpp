@@ -0,0 +1,112 @@
+#include "image_writer.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <cstdio>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Poster of 15 x 10 m at 20 pixels per meter, with commands that cross the borders of 64-row strips
+void createPoster(DisplayList& list)
+{
+    for(int i = 0; i < 20; ++i)
+    {
+        geo::Vec2 p(0.7 * i + 0.13, 0.45 * i + 0.3);
+        list.addLine(p, p + geo::Vec2(0.9, 2.1), Color(0, 0, 255, 1 + i % 3));
+        list.addCircle(p + geo::Vec2(0.4, 0.2), 0.1 * (1 + i % 5), Color(0, 150, 0, 2));
+    }
+
+    std::vector<geo::Vec2> points;
+    for(int i = 0; i < 40; ++i)
+        points.push_back(geo::Vec2(0.37 * i, 5 + 2.5 * sin(0.6 * i)));
+    list.addPolyline(points, false, Color(255, 0, 0, 2));
+
+    list.addRectangle(geo::Vec2(2.05, 3.1), geo::Vec2(4.3, 6.2), Color(100, 100, 100, 1));
+    list.addModel(createCircle(1.3), fromXYA(11, 4.2, 0.2), Color(0, 0, 0, 3));
+
+    // 8 x 8 pixels on 64 x 64 poster pixels, so the image scale is exact
+    cv::Mat image(8, 8, CV_8UC3);
+    for(int y = 0; y < image.rows; ++y)
+        for(int x = 0; x < image.cols; ++x)
+            image.at<cv::Vec3b>(y, x) = cv::Vec3b(30 * x, 30 * y, 200);
+    list.addImage(image, geo::Vec2(6, 2.8), geo::Vec2(9.2, 6));
+}
+
+// Rows 10 - 190: longer than a strip and the strip heights above and below it, so it is clipped
+void addWall(DisplayList& list, int thickness)
+{
+    list.addLine(geo::Vec2(13.1, 0.5), geo::Vec2(14.3, 9.5), Color(0, 0, 0, thickness));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(DisplayList, TiledPosterMatchesDraw)
+{
+    int width = 300;
+    int height = 200;
+    geo::Vec2 p1(0, 0);
+    geo::Vec2 p2(15, 10);
+    cv::Scalar background(255, 255, 255);
+
+    DisplayList list;
+    createPoster(list);
+    addWall(list, 3);
+
+    char dir[] = "/tmp/image_creator_test_display_list-XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != 0);
+
+    ImageWriter writer(width, height, p1, p2, background);
+    writer.setShow(false);
+    writer.setWrite(true);
+    writer.setWritePath(dir);
+    writer.setLabel("poster");
+    writer.processTiled(list, width, height, p1, p2, 64);
+
+    std::string filename = std::string(dir) + "/poster-0.png";
+    cv::Mat poster = cv::imread(filename);
+
+    std::remove(filename.c_str());
+    rmdir(dir);
+
+    ASSERT_EQ(width, poster.cols);
+    ASSERT_EQ(height, poster.rows);
+
+    Canvas canvas(width, height, background);
+    canvas.pixels_per_meter = width / (p2.x - p1.x);
+    canvas.center = cv::Point(cvRound(-p1.x * canvas.pixels_per_meter), cvRound(-p1.y * canvas.pixels_per_meter));
+    list.draw(canvas);
+
+    // Where the wall is clipped at the border of a strip's scratch rows its pixels can be off by one (see
+    // ImageWriter::processTiled), so it may differ within one pixel of the wall. Elsewhere nothing may differ.
+    DisplayList wall;
+    addWall(wall, 5);
+
+    Canvas wall_area(width, height, background);
+    wall_area.pixels_per_meter = canvas.pixels_per_meter;
+    wall_area.center = canvas.center;
+    wall.draw(wall_area);
+
+    int num_diff = 0;
+    for(int y = 0; y < height; ++y)
+    {
+        for(int x = 0; x < width; ++x)
+        {
+            if (poster.at<cv::Vec3b>(y, x) != canvas.image.at<cv::Vec3b>(y, x)
+                    && wall_area.image.at<cv::Vec3b>(y, x) == cv::Vec3b(255, 255, 255))
+                ++num_diff;
+        }
+    }
+
+    EXPECT_EQ(0, num_diff);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,80 @@
+#include "layer_stack.h"
+
+#include <gtest/gtest.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+void addShapes(DisplayList& list, double x, const Color& color)
+{
+    for(int i = 0; i < 8; ++i)
+    {
+        geo::Vec2 p(x + 0.1 * i, -1 + 0.25 * i);
+        list.addLine(p, p + geo::Vec2(1.2, 0.3), color);
+        list.addCircle(p, 0.2, color);
+    }
+}
+
+// All visible lists in order on a fresh canvas
+cv::Mat drawInOrder(const std::vector<const DisplayList*>& lists)
+{
+    Canvas canvas(160, 120, cv::Scalar(255, 255, 255));
+    canvas.pixels_per_meter = 40;
+    for(unsigned int i = 0; i < lists.size(); ++i)
+        lists[i]->draw(canvas);
+    return canvas.image;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(LayerStack, MatchesDrawingInOrder)
+{
+    LayerStack stack;
+    int i_bottom = stack.addLayer();
+    int i_middle = stack.addLayer();
+    int i_top = stack.addLayer();
+
+    addShapes(stack.edit(i_bottom), -1.8, Color(0, 0, 255, 3));
+    addShapes(stack.edit(i_middle), -1.2, Color(0, 150, 0, 2));
+    addShapes(stack.edit(i_top), -0.6, Color(255, 0, 0, 1));
+
+    Canvas canvas(160, 120, cv::Scalar(255, 255, 255));
+    canvas.pixels_per_meter = 40;
+    stack.draw(canvas);
+
+    std::vector<const DisplayList*> lists;
+    lists.push_back(&stack.layer(i_bottom));
+    lists.push_back(&stack.layer(i_middle));
+    lists.push_back(&stack.layer(i_top));
+    EXPECT_EQ(0, cv::norm(canvas.image, drawInOrder(lists), cv::NORM_INF));
+
+    // Edit the middle layer: the top layer is drawn again over the new middle
+    stack.edit(i_middle).addRectangle(geo::Vec2(-1, -0.5), geo::Vec2(0.8, 0.9), Color(0, 0, 0, 4));
+    stack.draw(canvas);
+    EXPECT_EQ(0, cv::norm(canvas.image, drawInOrder(lists), cv::NORM_INF));
+
+    // Hide the middle layer
+    stack.setVisible(i_middle, false);
+    stack.draw(canvas);
+
+    std::vector<const DisplayList*> visible_lists;
+    visible_lists.push_back(&stack.layer(i_bottom));
+    visible_lists.push_back(&stack.layer(i_top));
+    EXPECT_EQ(0, cv::norm(canvas.image, drawInOrder(visible_lists), cv::NORM_INF));
+
+    // And show it again
+    stack.setVisible(i_middle, true);
+    stack.draw(canvas);
+    EXPECT_EQ(0, cv::norm(canvas.image, drawInOrder(lists), cv::NORM_INF));
+
+    // Nothing changed: drawing again gives the same image
+    stack.draw(canvas);
+    EXPECT_EQ(0, cv::norm(canvas.image, drawInOrder(lists), cv::NORM_INF));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,124 @@
+#include "lrf.h"
+#include "world_model.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <gtest/gtest.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Scan with beams without a range, and end points up to well outside a 200 x 150 canvas at 40 pixels per meter
+void createScan(geo::LaserRangeFinder& lrf, std::vector<double>& ranges)
+{
+    lrf.setNumBeams(181);
+    lrf.setAngleLimits(-2.2, 2.2);
+    lrf.setRangeLimits(0.05, 10);
+
+    ranges.resize(lrf.getNumBeams());
+    for(unsigned int i = 0; i < ranges.size(); ++i)
+    {
+        if (i % 7 == 0)
+            ranges[i] = 0;
+        else if (i % 11 == 0)
+            ranges[i] = -1;
+        else
+            ranges[i] = 0.4 + 0.03 * i + 0.2 * sin(0.3 * i);
+    }
+}
+
+// The scan drawn beam by beam with cv::circle and cv::line
+void drawRangesPerBeam(Canvas& canvas, const geo::LaserRangeFinder& lrf, const geo::Transform2& lrf_pose,
+                       const std::vector<double>& ranges, const Color& point_color, const Color& line_color)
+{
+    cv::Point p_lrf = canvas.worldToImage(lrf_pose.t);
+    for(unsigned int i = 0; i < ranges.size(); ++i)
+    {
+        double r = ranges[i];
+        if (r <= 0)
+            continue;
+
+        const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+        cv::Point p = canvas.worldToImage(lrf_pose * geo::Vec2(r * ray_dir.x, r * ray_dir.y));
+
+        cv::circle(canvas.image, p, point_color.thickness, point_color.color, CV_FILLED);
+        if (line_color.valid)
+            cv::line(canvas.image, p_lrf, p, line_color.color, line_color.thickness);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(LRF, RangesToImagePointsMatchesPerBeam)
+{
+    geo::LaserRangeFinder lrf;
+    std::vector<double> ranges;
+    createScan(lrf, ranges);
+
+    Canvas canvas(200, 150, cv::Scalar(255, 255, 255));
+    canvas.pixels_per_meter = 40;
+
+    // Also a pose with negative image coordinates, where truncation and rounding differ
+    std::vector<geo::Transform2> poses;
+    poses.push_back(fromXYA(0.3, -0.2, 0.7));
+    poses.push_back(fromXYA(-2.9, 1.6, -2.4));
+
+    for(unsigned int j = 0; j < poses.size(); ++j)
+    {
+        std::vector<cv::Point> points;
+        rangesToImagePoints(canvas, lrf, poses[j], ranges, points);
+        ASSERT_EQ(ranges.size(), points.size());
+
+        for(unsigned int i = 0; i < ranges.size(); ++i)
+        {
+            if (ranges[i] <= 0)
+                continue;
+
+            const geo::Vec3& ray_dir = lrf.getRayDirection(i);
+            cv::Point p = canvas.worldToImage(poses[j] * geo::Vec2(ranges[i] * ray_dir.x, ranges[i] * ray_dir.y));
+            EXPECT_EQ(p.x, points[i].x) << "beam " << i;
+            EXPECT_EQ(p.y, points[i].y) << "beam " << i;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(LRF, DrawRangesMatchesPerBeam)
+{
+    geo::LaserRangeFinder lrf;
+    std::vector<double> ranges;
+    createScan(lrf, ranges);
+
+    geo::Transform2 lrf_pose = fromXYA(0.3, -0.2, 0.7);
+
+    for(int thickness = 1; thickness <= 3; ++thickness)
+    {
+        Color point_color(0, 0, 255, thickness);
+
+        // Points only, and points with rays
+        std::vector<Color> line_colors;
+        line_colors.push_back(Color());
+        line_colors.push_back(Color(0, 150, 0, 1));
+
+        for(unsigned int j = 0; j < line_colors.size(); ++j)
+        {
+            Canvas batch(200, 150, cv::Scalar(255, 255, 255));
+            batch.pixels_per_meter = 40;
+            drawRanges(batch, lrf, lrf_pose, ranges, point_color, line_colors[j]);
+
+            Canvas per_beam(200, 150, cv::Scalar(255, 255, 255));
+            per_beam.pixels_per_meter = 40;
+            drawRangesPerBeam(per_beam, lrf, lrf_pose, ranges, point_color, line_colors[j]);
+
+            EXPECT_EQ(0, cv::norm(batch.image, per_beam.image, cv::NORM_INF)) << "thickness " << thickness;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,74 @@
+#include "image_writer.h"
+#include "png_writer.h"
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cstdio>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(Palette, WritePngMatchesToBGR)
+{
+    Canvas canvas(160, 120, cv::Scalar(255, 255, 255), boost::shared_ptr<Palette>(new Palette));
+
+    // The background and 15 boxes: 16 colors, written with 4 bits per pixel
+    for(int i = 0; i < 15; ++i)
+    {
+        cv::Rect rect(10 * i, 8 * i, 20, 15);
+        canvas.modify(rect);
+        cv::rectangle(canvas.image, rect, canvas.ink(cv::Scalar(17 * i, 255 - 17 * i, (40 * i) % 256)), CV_FILLED);
+    }
+    ASSERT_EQ(16u, canvas.palette->colors().size());
+
+    char dir[] = "/tmp/image_creator_test_palette-XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != 0);
+    std::string filename = std::string(dir) + "/canvas.png";
+
+    ASSERT_TRUE(writePng(filename, canvas.image, &canvas.palette->colors()));
+    cv::Mat image = cv::imread(filename);
+
+    std::remove(filename.c_str());
+    rmdir(dir);
+
+    cv::Mat bgr;
+    canvas.toBGR(bgr);
+
+    ASSERT_EQ(bgr.cols, image.cols);
+    ASSERT_EQ(bgr.rows, image.rows);
+    ASSERT_EQ(bgr.type(), image.type());
+    EXPECT_EQ(0, cv::norm(bgr, image, cv::NORM_INF));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(Palette, CanvasPerFrame)
+{
+    ImageWriter writer(160, 120, geo::Vec2(0, 0), geo::Vec2(4, 3), cv::Scalar(255, 255, 255));
+    writer.setPaletteMode();
+
+    Canvas canvas1 = writer.nextCanvas();
+    canvas1.ink(cv::Scalar(0, 0, 255));
+    canvas1.ink(cv::Scalar(0, 150, 0));
+
+    // Colors of earlier frames do not end up in the palette of the next one
+    Canvas canvas2 = writer.nextCanvas();
+    ASSERT_TRUE(canvas2.palette);
+    EXPECT_NE(canvas1.palette, canvas2.palette);
+    EXPECT_EQ(1u, canvas2.palette->colors().size());
+    EXPECT_EQ(3u, canvas1.palette->colors().size());
+
+    writer.setPaletteMode(false);
+    EXPECT_FALSE(writer.nextCanvas().palette);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
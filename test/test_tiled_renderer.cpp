@@ -0,0 +1,74 @@
+#include "tiled_renderer.h"
+
+#include <gtest/gtest.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Commands crossing the borders of 32-pixel tiles, and partly outside the image
+void createScene(DisplayList& list)
+{
+    for(int i = 0; i < 30; ++i)
+    {
+        geo::Vec2 p(-3 + 0.23 * i, -2.2 + 0.17 * i);
+        list.addLine(p, p + geo::Vec2(1.3, 0.9 - 0.06 * i), Color(0, 0, 255, 1 + i % 3));
+        list.addCircle(p + geo::Vec2(0.5, -0.3), 0.05 * (1 + i % 7), Color(0, 150, 0, 2));
+    }
+
+    std::vector<geo::Vec2> points;
+    for(int i = 0; i < 40; ++i)
+        points.push_back(geo::Vec2(-2.7 + 0.15 * i, sin(0.5 * i)));
+    list.addPolyline(points, false, Color(255, 0, 0, 2));
+
+    list.addRectangle(geo::Vec2(-1.1, -0.7), geo::Vec2(0.9, 1.3), Color(100, 100, 100, 1));
+    list.addModel(createCircle(0.8), fromXYA(1.2, 0.4, 0.3), Color(0, 0, 0, 3));
+    list.addEllipse(geo::Vec2(-0.4, 0.9), geo::Vec2(0.6, 0.25), 0.4, Color(200, 0, 200, 2));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(TiledRenderer, MatchesDraw)
+{
+    DisplayList list;
+    createScene(list);
+
+    Canvas serial(200, 150, cv::Scalar(255, 255, 255));
+    serial.pixels_per_meter = 40;
+    list.draw(serial);
+
+    Canvas tiled(200, 150, cv::Scalar(255, 255, 255));
+    tiled.pixels_per_meter = 40;
+    TiledRenderer(32, 1).draw(tiled, list);
+
+    EXPECT_EQ(0, cv::norm(serial.image, tiled.image, cv::NORM_INF));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(TiledRenderer, DrawsOverExistingContent)
+{
+    DisplayList background;
+    background.addRectangle(geo::Vec2(-2, -1), geo::Vec2(2, 1), Color(50, 50, 50, 5));
+
+    DisplayList list;
+    createScene(list);
+
+    Canvas serial(200, 150, cv::Scalar(255, 255, 255));
+    serial.pixels_per_meter = 40;
+    background.draw(serial);
+    list.draw(serial);
+
+    Canvas tiled(200, 150, cv::Scalar(255, 255, 255));
+    tiled.pixels_per_meter = 40;
+    background.draw(tiled);
+    TiledRenderer(32, 1).draw(tiled, list);
+
+    EXPECT_EQ(0, cv::norm(serial.image, tiled.image, cv::NORM_INF));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
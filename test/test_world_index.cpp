@@ -0,0 +1,76 @@
+#include "world_index.h"
+
+#include <gtest/gtest.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Like a traced map: a clockwise outer contour around the walls, with a counter-clockwise hole for the room
+Model2D createTracedRoom(double size, double wall_thickness)
+{
+    Model2D model;
+    createBoxContour(geo::Vec2(-size / 2, -size / 2), geo::Vec2(size / 2, size / 2), model.addContour());
+
+    double inner = size / 2 - wall_thickness;
+    createBoxContour(geo::Vec2(-inner, -inner), geo::Vec2(inner, inner), model.addContour(), true);
+
+    return model;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(WorldIndex, TracedRoomIsFree)
+{
+    WorldModel2D wm;
+    wm.addEntity(createTracedRoom(10, 1), fromXYA(2, 3, 0.3));
+
+    WorldIndex index;
+    index.build(wm);
+
+    geo::Transform2 pose = wm.entities()[0].pose();
+
+    EXPECT_TRUE(index.isFree(pose * geo::Vec2(0, 0)));
+    EXPECT_TRUE(index.isFree(pose * geo::Vec2(3, -3), 0.5));
+    EXPECT_FALSE(index.isFree(pose * geo::Vec2(4.5, 0)));
+    EXPECT_TRUE(index.isFree(pose * geo::Vec2(20, 0)));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(WorldIndex, TracedRoomInsideRoom)
+{
+    WorldModel2D wm;
+    wm.addEntity(createBox(30, 30, true), geo::Transform2::identity());
+    wm.addEntity(createTracedRoom(10, 1), geo::Transform2::identity());
+
+    WorldIndex index;
+    index.build(wm);
+
+    EXPECT_TRUE(index.isFree(geo::Vec2(0, 0)));
+    EXPECT_FALSE(index.isFree(geo::Vec2(4.5, 0)));
+    EXPECT_TRUE(index.isFree(geo::Vec2(10, 0)));
+    EXPECT_FALSE(index.isFree(geo::Vec2(20, 0)));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+TEST(WorldIndex, OnlyInsideRooms)
+{
+    WorldModel2D wm;
+    wm.addEntity(createBox(10, 10, true), geo::Transform2::identity());
+    wm.addEntity(createBox(1, 1), fromXYA(2, 0, 0));
+
+    WorldIndex index;
+    index.build(wm);
+
+    EXPECT_TRUE(index.isFree(geo::Vec2(0, 0)));
+    EXPECT_FALSE(index.isFree(geo::Vec2(2, 0)));
+    EXPECT_FALSE(index.isFree(geo::Vec2(20, 0)));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}